@@ -17,6 +17,7 @@ ThreadPool::ThreadPool()
 	, isPoolRunning_(false)
 	, idleThreadSize_(0)
 	, curThreadSize_(0)
+	, generateId_(0)
 {}
 
 ThreadPool::~ThreadPool()
@@ -85,7 +86,7 @@ Result ThreadPool::submitTask(std::shared_ptr<Task> sp)
 	if (poolMode_ == PoolMode::MODE_CACHED && taskSize_ > idleThreadSize_ && curThreadSize_ < threadSizeThreshHold_) {
 		std::cout << ">>>create new thread" << std::endl;
 		// µthread̶߳
-		auto ptr = std::make_unique<Thread>(std::bind(&ThreadPool::threadFunc, this, std::placeholders::_1));
+		auto ptr = std::make_unique<Thread>(std::bind(&ThreadPool::threadFunc, this, std::placeholders::_1), generateId_++);
 		int threadId = ptr->getId();
 		threads_.emplace(threadId, std::move(ptr));
 		//threads_.emplace_back(std::move(ptr)); // unique_ptr ûֵ븳ֵ
@@ -111,15 +112,15 @@ void ThreadPool::start(int initThreadSize)
 	// ̶߳
 	for (size_t i = 0; i < initThreadSize_; i++) {
 		// thread̶߳ʱ򣬰̺߳thread̶߳
-		auto ptr = std::make_unique<Thread>(std::bind(&ThreadPool::threadFunc, this, std::placeholders::_1));
+		auto ptr = std::make_unique<Thread>(std::bind(&ThreadPool::threadFunc, this, std::placeholders::_1), generateId_++);
 		int threadId = ptr->getId();
 		threads_.emplace(threadId, std::move(ptr));
 		//threads_.emplace_back(std::move(ptr)); // unique_ptr ûֵ븳ֵ
 	}
 
-	// ߳
-	for (size_t i = 0; i < initThreadSize_; i++) {
-		threads_[i]->start();
+	// ̣߳߳id̳߳ط䣬±threads_
+	for (auto& item : threads_) {
+		item.second->start();
 		idleThreadSize_++; // ¼ʼ̵߳
 	}
 }
@@ -228,11 +229,9 @@ bool ThreadPool::checkRunningState() const
 }
 
 ////////////////////////////////// ̷߳ʵ
-int Thread::generateId_ = 0;
-
-Thread::Thread(ThreadFunc func)
+Thread::Thread(ThreadFunc func, int threadId)
 	:func_(func)
-	, threadId_(generateId_++)
+	, threadId_(threadId)
 {}
 
 Thread::~Thread()
@@ -152,7 +152,7 @@ public:
 	// ̺߳
 	using ThreadFunc = std::function<void(int)>;
 
-	Thread(ThreadFunc func);
+	Thread(ThreadFunc func, int threadId);
 	~Thread();
 
 	// ߳
@@ -162,8 +162,7 @@ public:
 	int getId() const;
 private:
 	ThreadFunc func_;
-	static int generateId_;
-	int threadId_; // ߳id
+	int threadId_; // ߳id̳߳ط
 
 };
 /*
@@ -226,6 +225,8 @@ private:
 
 	std::atomic_bool isPoolRunning_; // ¼ǰ̳߳صĹ״̬
 
+	int generateId_; // ߳idÿ̳߳ص
+
 	// ̺߳
 	void threadFunc(int threadid);
 
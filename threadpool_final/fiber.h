@@ -0,0 +1,304 @@
+#ifndef FIBER_H
+#define FIBER_H
+
+#ifdef __linux__
+
+#include <iostream>
+#include <vector>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <future>
+#include <cstdint>
+#include <ucontext.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#include "worker.h"
+
+// ThreadSanitizerʱЭ̵л
+#if defined(__SANITIZE_THREAD__)
+#define FIBER_TSAN 1
+#elif defined(__has_feature)
+#if __has_feature(thread_sanitizer)
+#define FIBER_TSAN 1
+#endif
+#endif
+#ifdef FIBER_TSAN
+extern "C" {
+void* __tsan_get_current_fiber(void);
+void* __tsan_create_fiber(unsigned flags);
+void __tsan_destroy_fiber(void* fiber);
+void __tsan_switch_to_fiber(void* fiber, unsigned flags);
+}
+#endif
+
+const size_t FIBER_STACK_SIZE = 64 * 1024; // ÿЭջĴСλֽ
+const int FIBER_STACK_MAX = 1024; // ЭջޣЭջռõڴ
+
+// Эջأÿջĵ͵ַһɷʵıҳջʱֱӴδ󣬲Ȼڴ
+// ջŻسиãջmaxSize
+class FiberStackPool
+{
+public:
+	FiberStackPool(size_t stackSize, int maxSize)
+		: pageSize_((size_t)sysconf(_SC_PAGESIZE))
+		, stackSize_((stackSize + pageSize_ - 1) / pageSize_ * pageSize_)
+		, maxSize_(maxSize)
+		, allocatedSize_(0)
+	{}
+
+	~FiberStackPool()
+	{
+		for (void* stack : freeStacks_) {
+			munmap((char*)stack - pageSize_, stackSize_ + pageSize_);
+		}
+	}
+
+	// ȡһջջĵ͵ַ(ҳ֮)ջʱnullptr
+	void* allocate()
+	{
+		std::unique_lock<std::mutex> lock(mtx_);
+		if (!freeStacks_.empty()) {
+			void* stack = freeStacks_.back();
+			freeStacks_.pop_back();
+			return stack;
+		}
+		if (allocatedSize_ >= maxSize_)
+			return nullptr;
+
+		void* base = mmap(nullptr, stackSize_ + pageSize_, PROT_READ | PROT_WRITE,
+			MAP_PRIVATE | MAP_ANONYMOUS | MAP_STACK, -1, 0);
+		if (base == MAP_FAILED) {
+			std::cerr << "fiber stack mmap fail." << std::endl;
+			return nullptr;
+		}
+		mprotect(base, pageSize_, PROT_NONE); // ҳ
+		allocatedSize_++;
+		return (char*)base + pageSize_;
+	}
+
+	void release(void* stack)
+	{
+		std::unique_lock<std::mutex> lock(mtx_);
+		freeStacks_.push_back(stack);
+	}
+
+	size_t getStackSize() const { return stackSize_; }
+
+	FiberStackPool(const FiberStackPool&) = delete;
+	FiberStackPool& operator=(const FiberStackPool&) = delete;
+private:
+	size_t pageSize_;
+	size_t stackSize_;
+	int maxSize_;
+	int allocatedSize_; // Ѿջ
+	std::vector<void*> freeStacks_;
+	std::mutex mtx_;
+};
+
+/*
+ջЭ̣Լջִfuncִ;֮߳ϼִ
+example:
+Fiber fiber(func, stack, stackSize, wake);
+fiber.resume(); // ִеfuncߵһι
+*/
+class Fiber
+{
+public:
+	// Э̿Լִʱãĳ̵߳resume
+	using WakeFunc = std::function<void(Fiber*)>;
+
+	Fiber(std::function<void()> func, void* stack, size_t stackSize, WakeFunc wake)
+		: func_(func)
+		, stack_(stack)
+		, wake_(wake)
+		, isDone_(false)
+	{
+		getcontext(&context_);
+		context_.uc_stack.ss_sp = stack;
+		context_.uc_stack.ss_size = stackSize;
+		context_.uc_link = nullptr;
+		uintptr_t ptr = (uintptr_t)this;
+		makecontext(&context_, (void(*)())&Fiber::entry, 2, (uint32_t)(ptr >> 32), (uint32_t)ptr);
+#ifdef FIBER_TSAN
+		tsanFiber_ = __tsan_create_fiber(0);
+#endif
+	}
+
+	~Fiber()
+	{
+#ifdef FIBER_TSAN
+		__tsan_destroy_fiber(tsanFiber_);
+#endif
+	}
+
+	// ڵǰִ߳Эֱ̣Э̽߹𣬷ЭǷѾ
+	// falseʱЭ̿Ѿ߳ϼִˣٷ
+	bool resume()
+	{
+		current() = this;
+#ifdef FIBER_TSAN
+		tsanCaller_ = __tsan_get_current_fiber();
+		__tsan_switch_to_fiber(tsanFiber_, 0);
+#endif
+		swapcontext(&callerContext_, &context_);
+		current() = nullptr;
+
+		bool isDone = isDone_;
+		if (afterSuspend_) {
+			// ЭѾȫлˣʱܰ߳
+			std::function<void()> func = std::move(afterSuspend_);
+			afterSuspend_ = nullptr;
+			func();
+		}
+		return isDone;
+	}
+
+	// ǰЭ̣лصresumeִ̺߳afterSuspendʲôʱwake
+	void suspend(std::function<void()> afterSuspend)
+	{
+		afterSuspend_ = std::move(afterSuspend);
+		switchToCaller();
+	}
+
+	// ùЭִ̼
+	void wake()
+	{
+		wake_(this);
+	}
+
+	void* getStack() const { return stack_; }
+
+	// ЭԼڴأ߳ϼִҲʹ֮ǰڴ棬Эʱ
+	WorkerArena& getArena() { return arena_; }
+
+	// ǰִ߳еЭ̣ЭʱΪnullptr
+	static Fiber*& current()
+	{
+		thread_local Fiber* fiber = nullptr;
+		return fiber;
+	}
+
+	Fiber(const Fiber&) = delete;
+	Fiber& operator=(const Fiber&) = delete;
+private:
+	ucontext_t context_; // Э̵
+	ucontext_t callerContext_; // resume̵߳ģÿresume
+	std::function<void()> func_;
+	void* stack_;
+	WakeFunc wake_;
+	std::function<void()> afterSuspend_;
+	WorkerArena arena_;
+	bool isDone_;
+#ifdef FIBER_TSAN
+	void* tsanFiber_;
+	void* tsanCaller_;
+#endif
+
+	static void entry(uint32_t high, uint32_t low)
+	{
+		Fiber* fiber = (Fiber*)(((uintptr_t)high << 32) | (uintptr_t)low);
+		fiber->func_();
+		fiber->isDone_ = true;
+		fiber->switchToCaller(); // ٻ
+	}
+
+	void switchToCaller()
+	{
+#ifdef FIBER_TSAN
+		__tsan_switch_to_fiber(tsanCaller_, 0);
+#endif
+		swapcontext(&context_, &callerContext_);
+	}
+};
+
+// ЭеȴʱЭ̡ọ́߳Эʱͨźһ߳
+class FiberSemaphore
+{
+public:
+	FiberSemaphore(int limit = 0)
+		: resLimit_(limit)
+	{}
+
+	// ȡһźԴ
+	void wait()
+	{
+		Fiber* fiber = Fiber::current();
+		std::unique_lock<std::mutex> lock(mtx_);
+		if (resLimit_ > 0) {
+			resLimit_--;
+			return;
+		}
+		if (fiber == nullptr) {
+			threadWaitSize_++;
+			cond_.wait(lock, [&]()->bool { return resLimit_ > 0; });
+			threadWaitSize_--;
+			resLimit_--;
+			return;
+		}
+
+		lock.unlock();
+		fiber->suspend([this, fiber]() {
+			std::unique_lock<std::mutex> lock(mtx_);
+			if (resLimit_ > 0) {
+				// ĹѾԴ
+				resLimit_--;
+				lock.unlock();
+				fiber->wake();
+				return;
+			}
+			fibers_.push_back(fiber);
+			});
+	}
+
+	// һźԴȻѵȴЭ
+	void post()
+	{
+		std::unique_lock<std::mutex> lock(mtx_);
+		if (!fibers_.empty()) {
+			Fiber* fiber = fibers_.front();
+			fibers_.pop_front();
+			lock.unlock();
+			fiber->wake();
+			return;
+		}
+		resLimit_++;
+		if (threadWaitSize_ > 0)
+			cond_.notify_all();
+	}
+private:
+	int resLimit_;
+	int threadWaitSize_ = 0; // ȴ߳
+	std::deque<Fiber*> fibers_; // ȴЭ
+	std::mutex mtx_;
+	std::condition_variable cond_;
+};
+
+// submitFiberķֵЭgetʱЭ̣߳
+template<typename T>
+class FiberFuture
+{
+public:
+	FiberFuture() = default;
+	FiberFuture(std::shared_future<T> future, std::shared_ptr<FiberSemaphore> done)
+		: future_(future)
+		, done_(done)
+	{}
+
+	// ȴִ꣬ȡֵԶε
+	T get()
+	{
+		done_->wait();
+		done_->post(); // ȴҲܷ
+		return future_.get();
+	}
+private:
+	std::shared_future<T> future_;
+	std::shared_ptr<FiberSemaphore> done_; // ִʱpost
+};
+
+#endif // __linux__
+
+#endif // !FIBER_H
@@ -0,0 +1,619 @@
+#ifndef PIPELINE_H
+#define PIPELINE_H
+
+#include <vector>
+#include <map>
+#include <memory>
+#include <atomic>
+#include <functional>
+#include <future>
+#include <exception>
+#include <thread>
+#include <utility>
+#include <type_traits>
+#include <climits>
+#include "threadpool.h"
+
+const int PIPELINE_CHANNEL_SIZE = 1024; // ׶֮ͨĬ
+const int PIPELINE_BATCH_SIZE = 64; // ׶εһύó߳
+
+// ׶εִзʽ
+enum class StageMode
+{
+	SERIAL_IN_ORDER, // ͬһʱֻһִУݽˮߵ˳
+	PARALLEL, // ִУ֤˳
+};
+
+// нζУ߶߶̰߳ȫ
+// ÿӼ¼ԼţߺֻCASƽԵλ
+template<typename T>
+class RingChannel
+{
+public:
+	RingChannel(size_t capacity)
+		: enqueuePos_(0)
+		, dequeuePos_(0)
+	{
+		size_t size = 2;
+		while (size < capacity)
+			size *= 2;
+		cells_.reset(new Cell[size]);
+		mask_ = size - 1;
+		for (size_t i = 0; i < size; i++) {
+			cells_[i].sequence.store(i, std::memory_order_relaxed);
+		}
+	}
+
+	// һݣʱfalse
+	bool tryPush(T&& value)
+	{
+		size_t pos = enqueuePos_.load(std::memory_order_relaxed);
+		for (;;) {
+			Cell& cell = cells_[pos & mask_];
+			size_t seq = cell.sequence.load(std::memory_order_acquire);
+			long long diff = (long long)seq - (long long)pos;
+			if (diff == 0) {
+				if (enqueuePos_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+					cell.value = std::move(value);
+					cell.sequence.store(pos + 1, std::memory_order_release);
+					return true;
+				}
+			}
+			else if (diff < 0) {
+				return false;
+			}
+			else {
+				pos = enqueuePos_.load(std::memory_order_relaxed);
+			}
+		}
+	}
+
+	// ȡһݣпʱfalse
+	bool tryPop(T& value)
+	{
+		size_t pos = dequeuePos_.load(std::memory_order_relaxed);
+		for (;;) {
+			Cell& cell = cells_[pos & mask_];
+			size_t seq = cell.sequence.load(std::memory_order_acquire);
+			long long diff = (long long)seq - (long long)(pos + 1);
+			if (diff == 0) {
+				if (dequeuePos_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+					value = std::move(cell.value);
+					cell.sequence.store(pos + mask_ + 1, std::memory_order_release);
+					return true;
+				}
+			}
+			else if (diff < 0) {
+				return false;
+			}
+			else {
+				pos = dequeuePos_.load(std::memory_order_relaxed);
+			}
+		}
+	}
+private:
+	struct Cell
+	{
+		std::atomic<size_t> sequence;
+		T value;
+	};
+
+	std::unique_ptr<Cell[]> cells_;
+	size_t mask_;
+	char pad0_[64]; // ߺߵλ÷ڲͬĻ
+	std::atomic<size_t> enqueuePos_;
+	char pad1_[64];
+	std::atomic<size_t> dequeuePos_;
+};
+
+class PipelineStage;
+
+// ׶֮ӣcreditsΪԽε
+// δһ֮ǰȡһȣδ֮Ź黹ͨԶ
+// δʱòȾͣγɷѹ
+class PipelineLinkBase
+{
+public:
+	PipelineLinkBase(int capacity)
+		: capacity(capacity)
+		, credits(capacity)
+		, size(0)
+		, producer(nullptr)
+		, consumer(nullptr)
+	{}
+	virtual ~PipelineLinkBase() = default;
+
+	const int capacity;
+	std::atomic_int credits;
+	std::atomic_int size; // ͨе
+	PipelineStage* producer;
+	PipelineStage* consumer;
+};
+
+// ˮеһݣseqΪˮߵ˳
+template<typename T>
+struct PipelineItem
+{
+	T value;
+	long long seq;
+};
+
+template<typename T>
+class PipelineLink : public PipelineLinkBase
+{
+public:
+	PipelineLink(int capacity)
+		: PipelineLinkBase(capacity)
+		, ring(capacity)
+	{}
+
+	RingChannel<PipelineItem<T>> ring;
+};
+
+// ׶εĻ
+class PipelineStage
+{
+public:
+	PipelineStage()
+		: running_(0)
+		, outBase_(nullptr)
+	{}
+	virtual ~PipelineStage() = default;
+
+	// ݿԴҲжʱύ̳߳
+	virtual void schedule() = 0;
+
+	// ԴԷ()ֻSERIAL_IN_ORDER׶
+	virtual long long getSeqLimit() const { return LLONG_MAX; }
+
+protected:
+	std::atomic_int running_; // ִе
+	PipelineLinkBase* outBase_; // ӣһ׶Ϊnullptr
+
+	// ȡһȣһ׶βҪ
+	bool acquireOutput()
+	{
+		if (outBase_ == nullptr)
+			return true;
+		int credits = outBase_->credits.load();
+		while (credits > 0) {
+			if (outBase_->credits.compare_exchange_weak(credits, credits - 1))
+				return true;
+		}
+		return false;
+	}
+
+	// ȡöȺûݿԴض
+	void returnOutput()
+	{
+		if (outBase_ != nullptr)
+			outBase_->credits++;
+	}
+
+	bool hasOutput() const
+	{
+		return outBase_ == nullptr || outBase_->credits > 0;
+	}
+};
+
+// ݵĽ׶
+template<typename T>
+class PipelineOutput : public PipelineStage
+{
+public:
+	PipelineOutput()
+		: out_(nullptr)
+	{}
+
+	void setOutput(PipelineLink<T>* link)
+	{
+		out_ = link;
+		outBase_ = link;
+		link->producer = this;
+	}
+
+	// ݷ֪ͨͨ
+	void emit(PipelineItem<T>&& item)
+	{
+		if (out_ == nullptr)
+			return; // һ׶εĽ
+		out_->ring.tryPush(std::move(item)); // Ѿȡöȣһɹ
+		out_->size++;
+		out_->consumer->schedule();
+	}
+
+protected:
+	PipelineLink<T>* out_;
+};
+
+// ˮ߹״̬н׶κӶ̳߳е
+template<typename Pool>
+class PipelineCore : public std::enable_shared_from_this<PipelineCore<Pool>>
+{
+public:
+	PipelineCore(Pool& pool)
+		: pool_(pool)
+		, total_(-1)
+		, finished_(0)
+		, isDone_(false)
+		, isFailed_(false)
+		, source_(nullptr)
+	{}
+
+	// ύ׶ε񣬺reactorЭ̻һ
+	// ׶εѾжסˣ޵submitTaskʱ̶߳ڵȴύû߳ȥȡ
+	void submit(std::function<void()> task)
+	{
+		auto self = this->shared_from_this();
+		std::vector<std::function<void()>> batch{ [self, task]() { task(); } };
+		pool_.dispatchBatch(batch, "pipeline");
+	}
+
+	// Դһtotal
+	void setTotal(long long total)
+	{
+		total_ = total;
+		if (finished_ == total)
+			complete();
+	}
+
+	// һ׶δһ
+	void finishOne()
+	{
+		if (++finished_ == total_)
+			complete();
+	}
+
+	// ׶κԴ׳쳣ˮֹͣfutureбһ쳣
+	void fail(std::exception_ptr error)
+	{
+		isFailed_ = true;
+		if (!isDone_.exchange(true))
+			done_.set_exception(error);
+	}
+
+	bool isFailed() const { return isFailed_; }
+
+	void setSource(PipelineStage* source) { source_ = source; }
+
+	// SERIAL_IN_ORDER׶ǰԴܿԼ
+	void scheduleSource()
+	{
+		if (source_ != nullptr)
+			source_->schedule();
+	}
+
+	// ԴԷޣȡн׶εСֵ
+	long long getSeqLimit() const
+	{
+		long long limit = LLONG_MAX;
+		for (auto& stage : stages) {
+			limit = std::min(limit, stage->getSeqLimit());
+		}
+		return limit;
+	}
+
+	std::future<void> getFuture() { return done_.get_future(); }
+
+	std::vector<std::shared_ptr<PipelineStage>> stages;
+	std::vector<std::shared_ptr<PipelineLinkBase>> links;
+private:
+	Pool& pool_;
+	std::atomic<long long> total_;
+	std::atomic<long long> finished_;
+	std::atomic_bool isDone_;
+	std::atomic_bool isFailed_; // ˮΪ쳣ֹͣ
+	std::promise<void> done_;
+	PipelineStage* source_; // Դ׶Σrun֮
+
+	void complete()
+	{
+		if (!isDone_.exchange(true))
+			done_.set_value();
+	}
+};
+
+// ý׶κѽ
+template<typename Out>
+struct PipelineCall
+{
+	template<typename Func, typename In>
+	static void run(Func& func, PipelineItem<In>& item, PipelineOutput<Out>* stage)
+	{
+		stage->emit(PipelineItem<Out>{ func(std::move(item.value)), item.seq });
+	}
+
+	// stageӣظһ׶Ϊ
+	template<typename Pool>
+	static std::function<PipelineLink<Out>*()> connect(std::shared_ptr<PipelineCore<Pool>> core, PipelineOutput<Out>* stage, int capacity)
+	{
+		return [core, stage, capacity]() {
+			auto link = std::make_shared<PipelineLink<Out>>(capacity);
+			core->links.emplace_back(link);
+			stage->setOutput(link.get());
+			return link.get();
+		};
+	}
+};
+
+// voidĽ׶ûֻһ׶
+template<>
+struct PipelineCall<void>
+{
+	template<typename Func, typename In>
+	static void run(Func& func, PipelineItem<In>& item, PipelineOutput<void>*)
+	{
+		func(std::move(item.value));
+	}
+
+	template<typename Pool>
+	static std::function<PipelineLink<void>*()> connect(std::shared_ptr<PipelineCore<Pool>>, PipelineOutput<void>*, int)
+	{
+		return nullptr;
+	}
+};
+
+// Դ׶Σsourceжȡֱfalse
+template<typename Pool, typename T>
+class PipelineSource : public PipelineOutput<T>
+{
+public:
+	PipelineSource(PipelineCore<Pool>* core, std::function<bool(T&)> source)
+		: core_(core)
+		, source_(source)
+		, seq_(0)
+		, isEnd_(false)
+	{}
+
+	void schedule() override
+	{
+		if (isEnd_ || !this->hasOutput() || seq_ >= core_->getSeqLimit() || core_->isFailed())
+			return;
+		int running = 0;
+		if (this->running_.compare_exchange_strong(running, 1))
+			core_->submit([this]() { drain(); });
+	}
+private:
+	PipelineCore<Pool>* core_;
+	std::function<bool(T&)> source_;
+	std::atomic<long long> seq_; // һݵţscheduleҲȡ
+	std::atomic_bool isEnd_;
+
+	void drain()
+	{
+		for (int n = 0; n < PIPELINE_BATCH_SIZE && !isEnd_ && !core_->isFailed(); n++) {
+			// SERIAL_IN_ORDER׶εĴʱͣ£ǰټ
+			if (seq_ >= core_->getSeqLimit())
+				break;
+			if (!this->acquireOutput())
+				break;
+			T value;
+			bool hasValue;
+			try {
+				hasValue = source_(value);
+			}
+			catch (...) {
+				this->returnOutput();
+				this->running_ = 0;
+				core_->fail(std::current_exception());
+				return;
+			}
+			if (!hasValue) {
+				this->returnOutput();
+				isEnd_ = true;
+				core_->setTotal(seq_);
+				break;
+			}
+			this->emit(PipelineItem<T>{ std::move(value), seq_++ });
+		}
+		this->running_ = 0;
+		schedule(); // ˳ǰ˶ȣ¼
+	}
+};
+
+// ݵĽ׶
+template<typename Pool, typename In, typename Out>
+class PipelineFilter : public PipelineOutput<Out>
+{
+public:
+	PipelineFilter(PipelineCore<Pool>* core, PipelineLink<In>* in, StageMode mode, std::function<Out(In)> func, int parallelism)
+		: core_(core)
+		, in_(in)
+		, mode_(mode)
+		, func_(func)
+		, parallelism_(mode == StageMode::SERIAL_IN_ORDER ? 1 : std::max(parallelism, 1))
+		, isLast_(false)
+		, nextSeq_(0)
+		, hasReady_(false)
+	{
+		in->consumer = this;
+	}
+
+	void setLast() { isLast_ = true; }
+
+	// ˳Ľ׶ֻ[nextSeq_, nextSeq_ + capacity)ڵ
+	// ǰpending_ռȣڲͨʱnextSeq_Ӧÿ϶ж
+	long long getSeqLimit() const override
+	{
+		if (mode_ != StageMode::SERIAL_IN_ORDER)
+			return LLONG_MAX;
+		return nextSeq_ + in_->capacity;
+	}
+
+	void schedule() override
+	{
+		for (;;) {
+			int running = this->running_;
+			if (running >= parallelism_ || !this->hasOutput() || (in_->size <= 0 && !hasReady_) || core_->isFailed())
+				return;
+			if (this->running_.compare_exchange_weak(running, running + 1))
+				core_->submit([this]() { drain(); });
+		}
+	}
+private:
+	PipelineCore<Pool>* core_;
+	PipelineLink<In>* in_;
+	StageMode mode_;
+	std::function<Out(In)> func_;
+	int parallelism_;
+	bool isLast_;
+
+	// ֻSERIAL_IN_ORDERʱʹãͬһʱֻһ
+	std::atomic<long long> nextSeq_; // һӦôݣԴȡ㴰
+	std::map<long long, PipelineItem<In>> pending_; // ǰݣǰݴٴ
+	std::atomic_bool hasReady_; // pending_пϴ
+
+	// ȡһҪ
+	bool next(PipelineItem<In>& item)
+	{
+		if (mode_ == StageMode::PARALLEL) {
+			if (!in_->ring.tryPop(item))
+				return false;
+			in_->size--;
+			return true;
+		}
+
+		if (!pending_.empty() && pending_.begin()->first == nextSeq_) {
+			item = std::move(pending_.begin()->second);
+			pending_.erase(pending_.begin());
+		}
+		else {
+			for (;;) {
+				if (!in_->ring.tryPop(item))
+					return false;
+				in_->size--;
+				if (item.seq == nextSeq_)
+					break;
+				long long seq = item.seq;
+				pending_.emplace(seq, std::move(item));
+			}
+		}
+		nextSeq_++;
+		return true;
+	}
+
+	void drain()
+	{
+		for (int n = 0; n < PIPELINE_BATCH_SIZE && !core_->isFailed(); n++) {
+			if (!this->acquireOutput())
+				break;
+			PipelineItem<In> item;
+			if (!next(item)) {
+				this->returnOutput();
+				break;
+			}
+			try {
+				PipelineCall<Out>::run(func_, item, this);
+			}
+			catch (...) {
+				// ׶κ׳쳣黹ȣֹͣˮ
+				this->returnOutput();
+				in_->credits++;
+				this->running_--;
+				core_->fail(std::current_exception());
+				return;
+			}
+
+			// ݴ꣬黹εĶȣ˳Ľ׶δǰˣԴԼ
+			in_->credits++;
+			in_->producer->schedule();
+			if (mode_ == StageMode::SERIAL_IN_ORDER)
+				core_->scheduleSource();
+			if (isLast_)
+				core_->finishOne();
+		}
+		if (mode_ == StageMode::SERIAL_IN_ORDER)
+			hasReady_ = !pending_.empty() && pending_.begin()->first == nextSeq_;
+		this->running_--;
+		schedule(); // ˳ǰݻȣ¼
+	}
+};
+
+/*
+ˮߣԴ -> ׶1 -> ׶2 -> ...ÿ׶ζ̳߳صִ߳
+׶֮нͨӣĽ׶λͣ
+example:
+auto pipeline = makePipeline<std::string>(pool)
+	.then(StageMode::PARALLEL, parse)
+	.then(StageMode::SERIAL_IN_ORDER, write);
+std::future<void> done = pipeline.run([&](std::string& line) { return bool(std::getline(file, line)); });
+done.get();
+һˮֻrunһΣԴ׶κ׳쳣ʱˮֹͣget׳һ쳣
+*/
+template<typename Pool, typename Head, typename Tail>
+class Pipeline
+{
+public:
+	Pipeline(Pool& pool, int capacity)
+		: pool_(pool)
+		, capacity_(capacity)
+		, core_(std::make_shared<PipelineCore<Pool>>(pool))
+		, head_(std::make_shared<PipelineLink<Head>>(capacity))
+	{
+		core_->links.emplace_back(head_);
+		auto head = head_;
+		makeInput_ = [head]() { return head.get(); };
+	}
+
+	// ˮĩβһ׶Σfuncһ׶εĽparallelismΪPARALLEL׶ͬʱִе
+	template<typename Func>
+	auto then(StageMode mode, Func func, int parallelism = std::thread::hardware_concurrency())
+		-> Pipeline<Pool, Head, decltype(func(std::declval<Tail>()))>
+	{
+		using Out = decltype(func(std::declval<Tail>()));
+		static_assert(!std::is_void<Tail>::value, "can not add stage after a stage returning void");
+
+		auto stage = std::make_shared<PipelineFilter<Pool, Tail, Out>>(core_.get(), makeInput_(), mode, func, parallelism);
+		core_->stages.emplace_back(stage);
+
+		Pipeline<Pool, Head, Out> next(pool_, capacity_, core_, head_);
+		next.makeInput_ = PipelineCall<Out>::connect(core_, stage.get(), capacity_);
+		next.last_ = [stage]() { stage->setLast(); };
+		return next;
+	}
+
+	// ʼУsourceÿζȡһݣûʱfalseݾһ׶κfuture
+	std::future<void> run(std::function<bool(Head&)> source)
+	{
+		std::future<void> result = core_->getFuture();
+		if (last_ == nullptr) {
+			std::cerr << "pipeline has no stage." << std::endl;
+			core_->setTotal(0);
+			return result;
+		}
+		last_();
+		auto stage = std::make_shared<PipelineSource<Pool, Head>>(core_.get(), source);
+		core_->stages.emplace_back(stage);
+		stage->setOutput(head_.get());
+		core_->setSource(stage.get());
+		stage->schedule();
+		return result;
+	}
+
+private:
+	template<typename P, typename H, typename T>
+	friend class Pipeline;
+
+	Pipeline(Pool& pool, int capacity, std::shared_ptr<PipelineCore<Pool>> core, std::shared_ptr<PipelineLink<Head>> head)
+		: pool_(pool)
+		, capacity_(capacity)
+		, core_(core)
+		, head_(head)
+	{}
+
+	Pool& pool_;
+	int capacity_;
+	std::shared_ptr<PipelineCore<Pool>> core_;
+	std::shared_ptr<PipelineLink<Head>> head_; // Դ͵һ׶֮
+	std::function<PipelineLink<Tail>*()> makeInput_; // һ׶ε
+	std::function<void()> last_; // һ׶αΪˮߵյ㣬ûн׶ʱΪnullptr
+};
+
+// һԴΪTˮߣcapacityΪÿͨ
+template<typename T, typename Pool>
+Pipeline<Pool, T, T> makePipeline(Pool& pool, int capacity = PIPELINE_CHANNEL_SIZE)
+{
+	return Pipeline<Pool, T, T>(pool, capacity);
+}
+
+#endif // !PIPELINE_H
@@ -0,0 +1,232 @@
+#ifndef REACTOR_H
+#define REACTOR_H
+
+#ifdef __linux__
+
+#include <iostream>
+#include <vector>
+#include <memory>
+#include <atomic>
+#include <mutex>
+#include <functional>
+#include <unordered_map>
+#include <thread>
+#include <cstdint>
+#include <cerrno>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+const int REACTOR_MAX_EVENTS = 128; // һepoll_waitȡľ¼
+
+/*
+epollfd¼ַThreadPoolУֻlinux¿
+һִ߳epoll_waitһ¼һԷ̳߳صУ̳߳صִ߳лص
+fdԱԵ + EPOLLONESHOTע᣺صҪݶ/дEAGAINΪֹ
+ͬһfdͬʱֻһصִУصغ¼
+*/
+class Reactor
+{
+public:
+	// fdĻصΪfd
+	using Handler = std::function<void(int)>;
+	// һ̳߳еĺ
+	using Dispatch = std::function<void(std::vector<std::function<void()>>&)>;
+
+	Reactor(Dispatch dispatch)
+		: dispatch_(dispatch)
+		, epollFd_(epoll_create1(EPOLL_CLOEXEC))
+		, wakeFd_(eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC))
+		, isRunning_(true)
+	{
+		if (epollFd_ < 0 || wakeFd_ < 0) {
+			std::cerr << "reactor create epoll/eventfd fail." << std::endl;
+			isRunning_ = false;
+			return;
+		}
+		// eventfdepoll_wait
+		epoll_event ev{};
+		ev.events = EPOLLIN;
+		ev.data.fd = wakeFd_;
+		epoll_ctl(epollFd_, EPOLL_CTL_ADD, wakeFd_, &ev);
+		thread_ = std::thread(&Reactor::loop, this);
+	}
+
+	~Reactor()
+	{
+		stop();
+		if (epollFd_ >= 0)
+			close(epollFd_);
+		if (wakeFd_ >= 0)
+			close(wakeFd_);
+	}
+
+	// ַֹͣ¼ѾеĻصճִ
+	void stop()
+	{
+		if (isRunning_.exchange(false)) {
+			uint64_t one = 1;
+			ssize_t n = write(wakeFd_, &one, sizeof(one));
+			(void)n;
+		}
+		if (thread_.joinable())
+			thread_.join();
+	}
+
+	// fdɶʱִ̳߳handlerظע滻֮ǰhandler
+	bool onReadable(int fd, Handler handler)
+	{
+		return setHandler(fd, std::move(handler), true);
+	}
+
+	// fdдʱִ̳߳handlerظע滻֮ǰhandler
+	bool onWritable(int fd, Handler handler)
+	{
+		return setHandler(fd, std::move(handler), false);
+	}
+
+	// ټfdѾеĻصճִ
+	void remove(int fd)
+	{
+		std::unique_lock<std::mutex> lock(mtx_);
+		if (entries_.erase(fd) > 0)
+			epoll_ctl(epollFd_, EPOLL_CTL_DEL, fd, nullptr);
+	}
+
+	Reactor(const Reactor&) = delete;
+	Reactor& operator=(const Reactor&) = delete;
+private:
+	// һfdעĻص
+	struct Entry
+	{
+		Handler readHandler;
+		Handler writeHandler;
+		bool isDispatched; // صѾУû¼
+	};
+
+	Dispatch dispatch_;
+	int epollFd_;
+	int wakeFd_; // epoll_waiteventfd
+	std::atomic_bool isRunning_;
+	std::thread thread_;
+
+	std::mutex mtx_; // ֤entries_̰߳ȫ
+	std::unordered_map<int, Entry> entries_;
+
+	// עĻص¼
+	static uint32_t eventsOf(const Entry& entry)
+	{
+		uint32_t events = EPOLLET | EPOLLONESHOT;
+		if (entry.readHandler)
+			events |= EPOLLIN | EPOLLRDHUP;
+		if (entry.writeHandler)
+			events |= EPOLLOUT;
+		return events;
+	}
+
+	// ޸epollļǰҪȡmtx_
+	bool control(int op, int fd, const Entry& entry)
+	{
+		epoll_event ev{};
+		ev.events = eventsOf(entry);
+		ev.data.fd = fd;
+		if (epoll_ctl(epollFd_, op, fd, &ev) < 0) {
+			std::cerr << "reactor epoll_ctl fail, fd: " << fd << std::endl;
+			return false;
+		}
+		return true;
+	}
+
+	bool setHandler(int fd, Handler handler, bool isRead)
+	{
+		if (!isRunning_)
+			return false;
+		std::unique_lock<std::mutex> lock(mtx_);
+		auto it = entries_.find(fd);
+		if (it == entries_.end()) {
+			Entry entry{ nullptr, nullptr, false };
+			(isRead ? entry.readHandler : entry.writeHandler) = std::move(handler);
+			if (!control(EPOLL_CTL_ADD, fd, entry))
+				return false;
+			entries_.emplace(fd, std::move(entry));
+			return true;
+		}
+
+		Entry& entry = it->second;
+		(isRead ? entry.readHandler : entry.writeHandler) = std::move(handler);
+		// صִеfdȻصغ¼
+		if (entry.isDispatched)
+			return true;
+		return control(EPOLL_CTL_MOD, fd, entry);
+	}
+
+	// صغ¼fd
+	void rearm(int fd)
+	{
+		std::unique_lock<std::mutex> lock(mtx_);
+		auto it = entries_.find(fd);
+		if (it == entries_.end())
+			return;
+		it->second.isDispatched = false;
+		control(EPOLL_CTL_MOD, fd, it->second);
+	}
+
+	// ¼ѭһepoll_waitо¼һַ
+	void loop()
+	{
+		epoll_event events[REACTOR_MAX_EVENTS];
+		std::vector<std::function<void()>> batch;
+		while (isRunning_) {
+			int n = epoll_wait(epollFd_, events, REACTOR_MAX_EVENTS, -1);
+			if (n < 0) {
+				if (errno == EINTR)
+					continue;
+				// Ҳָ˳¼ѭѾעfdٱַ
+				std::cerr << "reactor epoll_wait fail, errno: " << errno << std::endl;
+				break;
+			}
+
+			{
+				std::unique_lock<std::mutex> lock(mtx_);
+				for (int i = 0; i < n; i++) {
+					int fd = events[i].data.fd;
+					if (fd == wakeFd_) {
+						uint64_t count;
+						ssize_t r = read(wakeFd_, &count, sizeof(count));
+						(void)r;
+						continue;
+					}
+
+					auto it = entries_.find(fd);
+					if (it == entries_.end())
+						continue;
+					Entry& entry = it->second;
+					uint32_t ready = events[i].events;
+					Handler readHandler, writeHandler;
+					if ((ready & (EPOLLIN | EPOLLRDHUP | EPOLLHUP | EPOLLERR)) && entry.readHandler)
+						readHandler = entry.readHandler;
+					if ((ready & (EPOLLOUT | EPOLLHUP | EPOLLERR)) && entry.writeHandler)
+						writeHandler = entry.writeHandler;
+					entry.isDispatched = true;
+
+					batch.emplace_back([this, fd, readHandler, writeHandler]() {
+						if (readHandler)
+							readHandler(fd);
+						if (writeHandler)
+							writeHandler(fd);
+						rearm(fd);
+						});
+				}
+			}
+
+			if (!batch.empty()) {
+				dispatch_(batch);
+				batch.clear();
+			}
+		}
+	}
+};
+
+#endif // __linux__
+
+#endif // !REACTOR_H
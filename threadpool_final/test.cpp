@@ -1,6 +1,17 @@
+#define THREADPOOL_NO_LOG // ر̳߳صĵֻԽ
 #include <iostream>
 #include <future>
+#include <vector>
+#include <sstream>
+#include <fstream>
+#include <string>
+#include <cstdio>
 #include "threadpool.h"
+#include "pipeline.h"
+#ifdef __linux__
+#include <fcntl.h>
+#include <sys/socket.h>
+#endif
 using namespace std;
 
 int sum1(int a, int b)
@@ -13,6 +24,774 @@ int sum2(int a, int b, int c)
 	return a + b + c;
 }
 
+// ѹԣύͬʱͣص߳޺Ϳʱ
+void testResize()
+{
+	ThreadPool pool;
+	pool.setMode(PoolMode::MODE_CACHED);
+	pool.start(4);
+
+	atomic_bool done(false);
+	thread resizer([&]() {
+		int size = 1;
+		while (!done) {
+			pool.setThreadSize(size);
+			pool.setTaskQueMaxThreshHold(64 + size * 16);
+			pool.setThreadMaxIdleTime(size);
+			size = size % 8 + 1;
+			this_thread::sleep_for(chrono::milliseconds(1));
+		}
+	});
+
+	vector<future<int>> results;
+	for (int i = 0; i < 2000; i++) {
+		results.emplace_back(pool.submitTask(sum1, i, 1));
+	}
+	long long total = 0;
+	for (auto& res : results) {
+		total += res.get();
+	}
+	done = true;
+	resizer.join();
+
+	// ÿҪִִֻһΣsum(i + 1), i = 0..1999
+	cout << "resize test: " << (total == 2001000 ? "ok" : "fail") << endl;
+}
+
+// ռ˹̶̣߳ͨȻԱִ߳
+void testBlocking()
+{
+	ThreadPool pool;
+	pool.start(2);
+
+	promise<void> gate;
+	shared_future<void> opened = gate.get_future().share();
+	future<void> b1 = pool.submitBlocking([opened]() { opened.wait(); });
+	future<void> b2 = pool.submitBlocking([opened]() { opened.wait(); });
+	future<int> r = pool.submitTask(sum1, 1, 2);
+
+	bool ok = r.wait_for(chrono::seconds(2)) == future_status::ready && r.get() == 3;
+	gate.set_value();
+	b1.get();
+	b2.get();
+
+	// 󣬱߳˳ָ߳
+	for (int i = 0; i < 100 && pool.getThreadSize() != 2; i++) {
+		this_thread::sleep_for(chrono::milliseconds(10));
+	}
+	ok = ok && pool.getThreadSize() == 2;
+
+	// cachedģʽ±߳̿гʱҲܵ߳˳ʱյ߳
+	ThreadPool cachedPool;
+	cachedPool.setMode(PoolMode::MODE_CACHED);
+	cachedPool.setThreadMaxIdleTime(1);
+	cachedPool.start(2);
+	promise<void> cachedGate;
+	shared_future<void> cachedOpened = cachedGate.get_future().share();
+	future<void> c1 = cachedPool.submitBlocking([cachedOpened]() { cachedOpened.wait(); });
+	future<void> c2 = cachedPool.submitBlocking([cachedOpened]() { cachedOpened.wait(); });
+	this_thread::sleep_for(chrono::milliseconds(2500)); // ʱ
+	cachedGate.set_value();
+	c1.get();
+	c2.get();
+	for (int i = 0; i < 100 && cachedPool.getThreadSize() != 2; i++) {
+		this_thread::sleep_for(chrono::milliseconds(10));
+	}
+	this_thread::sleep_for(chrono::milliseconds(100)); // ˳̲߳˳
+	ok = ok && cachedPool.getThreadSize() == 2;
+	cout << "blocking test: " << (ok ? "ok" : "fail") << endl;
+}
+
+// traceÿһ¼ΪChrome Trace Eventʽ
+void testTrace()
+{
+	ThreadPool pool;
+	pool.start(2);
+	pool.enableTrace();
+
+	vector<future<int>> results;
+	for (int i = 0; i < 10; i++) {
+		results.emplace_back(pool.submitNamedTask("sum\"1\"", sum1, i, i));
+	}
+	results.emplace_back(pool.submitTask(sum2, 1, 2, 3));
+	for (auto& res : results) {
+		res.get();
+	}
+
+	// getʱtrace¼ܻûм¼һ
+	string json;
+	size_t count = 0;
+	for (int i = 0; i < 100 && count < 11; i++) {
+		if (i > 0)
+			this_thread::sleep_for(chrono::milliseconds(10));
+		ostringstream out;
+		pool.dumpTrace(out);
+		json = out.str();
+		count = 0;
+		for (size_t pos = json.find("\"ph\":\"X\""); pos != string::npos; pos = json.find("\"ph\":\"X\"", pos + 1)) {
+			count++;
+		}
+	}
+	pool.disableTrace();
+	bool ok = count == 11 && json.find("sum\\\"1\\\"") != string::npos;
+	cout << "trace test: " << (ok ? "ok" : "fail") << endl;
+}
+
+// ͬkeyִڼִֻһΣttlҲظִ
+void testShared()
+{
+	ThreadPool pool;
+	pool.start(4);
+
+	atomic_int runs(0);
+	promise<void> gate;
+	shared_future<void> opened = gate.get_future().share();
+	auto load = [&](int key) {
+		opened.wait();
+		runs++;
+		return key * 10;
+	};
+
+	vector<shared_future<int>> results;
+	for (int i = 0; i < 500; i++) {
+		results.emplace_back(pool.submitShared("key:7", load, 7));
+	}
+	gate.set_value();
+	bool ok = true;
+	for (auto& res : results) {
+		ok = ok && res.get() == 70;
+	}
+	ok = ok && runs == 1;
+
+	pool.setSharedCache(1000, 8);
+	pool.submitShared("key:8", load, 8).get();
+	ok = ok && pool.submitShared("key:8", load, 8).get() == 80 && runs == 2;
+
+	// keyһ໺8
+	for (int i = 100; i < 120; i++) {
+		pool.submitShared("key:" + to_string(i), load, i).get();
+	}
+	int before = runs;
+	for (int i = 100; i < 120; i++) {
+		pool.submitShared("key:" + to_string(i), load, i).get();
+	}
+	ok = ok && runs - before >= 12;
+
+	// ύʧܷصֵᱻ
+	BasicThreadPool<FixedSize> fullPool;
+	fullPool.setTaskQueMaxThreshHold(1);
+	fullPool.setSharedCache(1000, 8);
+	fullPool.start(1);
+	promise<void> release;
+	shared_future<void> released = release.get_future().share();
+	fullPool.submitTask([released]() { released.wait(); });
+	fullPool.submitTask([]() {}); // һʼִкܷ룬֮һֱ
+	ok = ok && fullPool.submitShared("key:9", load, 9).get() == 0;
+	release.set_value();
+	ok = ok && fullPool.submitShared("key:9", load, 9).get() == 90;
+	cout << "shared test: " << (ok ? "ok" : "fail") << endl;
+}
+
+// ⻧лѹʱ3:1Ȩطִʱ
+void testTenant()
+{
+	ThreadPool pool;
+	pool.start(2);
+	int heavy = pool.addTenant(3);
+	int light = pool.addTenant(1);
+
+	auto spin = []() {
+		auto end = chrono::steady_clock::now() + chrono::microseconds(200);
+		while (chrono::steady_clock::now() < end) {}
+	};
+	vector<future<void>> results;
+	for (int i = 0; i < 400; i++) {
+		results.emplace_back(pool.submitTenantTask(heavy, spin));
+		results.emplace_back(pool.submitTenantTask(light, spin));
+	}
+	// ⻧ĶжʱȽִʱ
+	while (pool.getTenantStats(light).queueSize > 200 && pool.getTenantStats(heavy).queueSize > 0) {
+		this_thread::sleep_for(chrono::milliseconds(1));
+	}
+	TenantStats heavyStats = pool.getTenantStats(heavy);
+	TenantStats lightStats = pool.getTenantStats(light);
+	for (auto& res : results) {
+		res.get();
+	}
+
+	double ratio = heavyStats.runTime / lightStats.runTime;
+	bool ok = ratio > 2 && ratio < 4.5 && pool.getTenantStats(light).startedSize == 400;
+	cout << "tenant test: " << (ok ? "ok" : "fail") << " (run time ratio " << ratio
+		<< ", light avg wait " << pool.getTenantStats(light).avgWaitTime << "ms)" << endl;
+}
+
+// пõǰ̵߳±ꡢֲ߳̾ڴ
+void testWorker()
+{
+	BasicThreadPool<FixedSize> pool;
+	pool.start(3);
+
+	atomic_int initSize(0);
+	atomic_int badSize(0);
+	vector<future<int>> results;
+	for (int i = 0; i < 1000; i++) {
+		results.emplace_back(pool.submitTask([&]() {
+			WorkerContext* worker = ThreadPool::currentWorker();
+			if (worker == nullptr || worker->getIndex() < 0 || worker->getIndex() >= 3) {
+				badSize++;
+				return 0;
+			}
+			// ÿֻ߳ʼһ
+			int& count = worker->local<int>([&]() { initSize++; return 0; });
+			count++;
+			int* buf = worker->getArena().allocateArray<int>(1000);
+			for (int j = 0; j < 1000; j++) {
+				buf[j] = j;
+			}
+			double* big = worker->getArena().allocateArray<double>(100000); // һ
+			big[99999] = 1;
+			if ((uintptr_t)big % alignof(double) != 0)
+				badSize++;
+			return buf[999];
+			}));
+	}
+	int sum = 0;
+	for (auto& res : results) {
+		sum += res.get();
+	}
+	bool ok = sum == 999 * 1000 && badSize == 0 && initSize >= 1 && initSize <= 3
+		&& ThreadPool::currentWorker() == nullptr;
+	cout << "worker test: " << (ok ? "ok" : "fail") << endl;
+}
+
+void testNextSlot()
+{
+	ThreadPool pool;
+	pool.start(3);
+
+	// ߳ύnextۣǰͬһִ߳
+	int sameSize = 0;
+	for (int i = 0; i < 100; i++) {
+		int index = pool.submitTask([&pool]() {
+			int index = ThreadPool::currentWorker()->getIndex();
+			return pool.submitTask([index]() { return ThreadPool::currentWorker()->getIndex() == index; });
+			}).get().get();
+		sameSize += index;
+	}
+
+	// еȴnextĽɿִ߳У
+	int value = pool.submitTask([&pool]() {
+		return pool.submitTask(sum1, 20, 22).get();
+		}).get();
+
+	// һֱʱеȴnextĽҲõȵп
+	atomic_int floodSize(0);
+	int floodAtParent = -1;
+	{
+		ThreadPool floodPool;
+		floodPool.start(2);
+		future<int> parent = floodPool.submitTask([&floodPool, &floodSize]() {
+			int value = floodPool.submitTask(sum1, 20, 22).get();
+			return value == 42 ? floodSize.load() : -1;
+			});
+		for (int i = 0; i < 1000; i++) {
+			floodPool.submitTask([&floodSize]() {
+				this_thread::sleep_for(chrono::microseconds(200));
+				floodSize++;
+				});
+		}
+		floodAtParent = parent.get();
+	}
+
+	// cachedģʽ±next۵ʱҲ߳
+	int fanThreadSize = 0;
+	auto fanBegin = chrono::steady_clock::now();
+	{
+		ThreadPool fanPool;
+		fanPool.setMode(PoolMode::MODE_CACHED);
+		fanPool.start(1);
+		fanPool.submitTask([&fanPool]() {
+			vector<future<void>> children;
+			for (int i = 0; i < 8; i++) {
+				children.emplace_back(fanPool.submitTask([]() { this_thread::sleep_for(chrono::milliseconds(100)); }));
+			}
+			for (auto& child : children) {
+				child.get();
+			}
+			}).get();
+		fanThreadSize = fanPool.getThreadSize();
+	}
+	auto fanTime = chrono::duration_cast<chrono::milliseconds>(chrono::steady_clock::now() - fanBegin).count();
+
+	// ʱ߳ύҲƣѾܵڲУȴ1sύʧ
+	ThreadPool fullPool;
+	fullPool.setTaskQueMaxThreshHold(1);
+	fullPool.start(1);
+	auto subs = fullPool.submitTask([&fullPool]() {
+		vector<future<int>> subs;
+		for (int i = 1; i <= 3; i++) {
+			subs.emplace_back(fullPool.submitTask([i]() { return i; }));
+		}
+		return subs;
+		}).get();
+	int fullSum = 0;
+	for (auto& sub : subs) {
+		fullSum += sub.get();
+	}
+	unsigned long long fullRejected = fullPool.getTenantStats(0).rejectedSize;
+
+	// ̶߳æʱֱύִ߳
+	BasicThreadPool<FixedSize> busyPool;
+	busyPool.start(1);
+	promise<void> release;
+	shared_future<void> released = release.get_future().share();
+	busyPool.submitTask([released]() { released.wait(); });
+	busyPool.submitTask([]() {}); // ٻѹһ
+	bool isInline = busyPool.submitInlineIfBusy([]() { return this_thread::get_id(); }).get() == this_thread::get_id();
+	release.set_value();
+
+	bool ok = sameSize >= 50 && value == 42 && fullSum == 3 && fullRejected == 1 && isInline
+		&& floodAtParent >= 0 && floodAtParent < 500 && fanThreadSize > 1 && fanTime < 300;
+	cout << "next slot test: " << (ok ? "ok" : "fail") << " (same worker " << sameSize << "/100, fan out "
+		<< fanThreadSize << " threads " << fanTime << "ms)" << endl;
+}
+
+// н׶֮Ĵн׶ΰԭ˳յݣĽ׶Դͣ
+void testPipeline()
+{
+	ThreadPool pool;
+	pool.start(4);
+
+	const int count = 10000;
+	const int capacity = 16;
+	atomic_int produced(0), consumed(0), maxInFlight(0);
+	int next = 0;
+	bool isOrdered = true;
+	int expect = 0;
+	auto pipeline = makePipeline<int>(pool, capacity)
+		.then(StageMode::PARALLEL, [](int x) { return x * 2; })
+		.then(StageMode::SERIAL_IN_ORDER, [&](int x) {
+			isOrdered = isOrdered && x == expect;
+			expect += 2;
+			if (x % 1000 == 0)
+				this_thread::sleep_for(chrono::milliseconds(1));
+			consumed++;
+		});
+	future<void> done = pipeline.run([&](int& x) {
+		if (next == count)
+			return false;
+		x = next++;
+		int inFlight = ++produced - consumed;
+		if (inFlight > maxInFlight)
+			maxInFlight = inFlight;
+		return true;
+	});
+
+	bool ok = done.wait_for(chrono::seconds(10)) == future_status::ready
+		&& isOrdered && consumed == count && maxInFlight <= capacity * 2 + 1;
+
+	// н׶֮Ӱ˳Ľ׶ΣǰռŶʱǰҲҪõ
+	const int orderCount = 200;
+	int orderNext = 0;
+	int orderExpect = 0;
+	bool isOrderOk = true;
+	ThreadPool orderPool;
+	orderPool.start(4);
+	auto ordered = makePipeline<int>(orderPool, 4)
+		.then(StageMode::PARALLEL, [](int x) {
+			if (x % 50 == 0)
+				this_thread::sleep_for(chrono::milliseconds(50));
+			return x;
+		}, 4)
+		.then(StageMode::PARALLEL, [](int x) { return x; }, 4)
+		.then(StageMode::SERIAL_IN_ORDER, [&](int x) {
+			isOrderOk = isOrderOk && x == orderExpect;
+			orderExpect++;
+		});
+	future<void> orderDone = ordered.run([&](int& x) {
+		if (orderNext == orderCount)
+			return false;
+		x = orderNext++;
+		return true;
+	});
+	ok = ok && orderDone.wait_for(chrono::seconds(5)) == future_status::ready
+		&& isOrderOk && orderExpect == orderCount;
+
+	// ޺СʱΨһ߳ύ׶εҲΪס
+	int smallNext = 0;
+	int smallSize = 0;
+	ThreadPool smallPool;
+	smallPool.setTaskQueMaxThreshHold(1);
+	smallPool.setNextSlot(false);
+	smallPool.start(1);
+	auto small = makePipeline<int>(smallPool, capacity)
+		.then(StageMode::PARALLEL, [](int x) { return x; }, 4)
+		.then(StageMode::PARALLEL, [](int x) { return x; }, 4)
+		.then(StageMode::SERIAL_IN_ORDER, [&](int) { smallSize++; });
+	future<void> smallDone = small.run([&](int& x) {
+		if (smallNext == count)
+			return false;
+		x = smallNext++;
+		return true;
+	});
+	ok = ok && smallDone.wait_for(chrono::seconds(5)) == future_status::ready && smallSize == count;
+
+	// cachedģʽ½׶εڿ߳ʱ߳
+	int cachedNext = 0;
+	ThreadPool cachedPool;
+	cachedPool.setMode(PoolMode::MODE_CACHED);
+	cachedPool.start(1);
+	auto cached = makePipeline<int>(cachedPool, capacity)
+		.then(StageMode::PARALLEL, [](int x) {
+			this_thread::sleep_for(chrono::milliseconds(50));
+			return x;
+		}, 4)
+		.then(StageMode::SERIAL_IN_ORDER, [](int) {});
+	auto cachedBegin = chrono::steady_clock::now();
+	cached.run([&](int& x) {
+		if (cachedNext == 8)
+			return false;
+		x = cachedNext++;
+		return true;
+	}).wait();
+	ok = ok && cachedPool.getThreadSize() > 1
+		&& chrono::steady_clock::now() - cachedBegin < chrono::milliseconds(300);
+
+	// ׶κԴ׳쳣ʱˮֹͣget׳쳣
+	// ˮֹͣʱִܻУõıҪ̳߳ػþ
+	int values[2] = { 0, 0 };
+	ThreadPool failPool;
+	failPool.start(2);
+	for (int throwAt : { 5, -5 }) {
+		int& value = values[throwAt > 0 ? 0 : 1];
+		auto failing = makePipeline<int>(failPool, capacity)
+			.then(StageMode::PARALLEL, [throwAt](int x) {
+				if (x == throwAt)
+					throw runtime_error("stage");
+				return x;
+			})
+			.then(StageMode::SERIAL_IN_ORDER, [](int) {});
+		future<void> failed = failing.run([&value, throwAt](int& x) {
+			if (value == -throwAt)
+				throw runtime_error("source");
+			x = value++;
+			return value < count;
+		});
+		ok = ok && failed.wait_for(chrono::seconds(2)) == future_status::ready;
+		try {
+			failed.get();
+			ok = false;
+		}
+		catch (const runtime_error& e) {
+			ok = ok && string(e.what()) == (throwAt > 0 ? "stage" : "source");
+		}
+	}
+	cout << "pipeline test: " << (ok ? "ok" : "fail") << endl;
+}
+
+#ifdef __linux__
+// pipeɶsocketpairдʱصִ̳߳
+void testReactor()
+{
+	ThreadPool pool;
+	pool.start(2);
+
+	int pipefd[2];
+	pipe(pipefd);
+	fcntl(pipefd[0], F_SETFL, O_NONBLOCK);
+	atomic_int received(0);
+	promise<void> allReceived;
+	pool.onReadable(pipefd[0], [&](int fd) {
+		// ԵEAGAINΪֹ
+		char buf[64];
+		ssize_t n;
+		while ((n = read(fd, buf, sizeof(buf))) > 0) {
+			if ((received += (int)n) == 100)
+				allReceived.set_value();
+		}
+		});
+	for (int i = 0; i < 100; i++) {
+		write(pipefd[1], "x", 1);
+	}
+	bool ok = allReceived.get_future().wait_for(chrono::seconds(2)) == future_status::ready;
+
+	int sv[2];
+	socketpair(AF_UNIX, SOCK_STREAM, 0, sv);
+	promise<int> writable;
+	pool.onWritable(sv[0], [&](int fd) {
+		pool.removeFd(fd);
+		writable.set_value(fd);
+		});
+	future<int> w = writable.get_future();
+	ok = ok && w.wait_for(chrono::seconds(2)) == future_status::ready && w.get() == sv[0];
+
+	pool.removeFd(pipefd[0]);
+	close(pipefd[0]);
+	close(pipefd[1]);
+	close(sv[0]);
+	close(sv[1]);
+	cout << "reactor test: " << (ok ? "ok" : "fail") << endl;
+}
+
+void testFiber()
+{
+	// ֻһ̣߳Э̵ȴʱռס߳̾ͻ
+	BasicThreadPool<FixedSize> pool;
+	pool.start(1);
+
+	FiberSemaphore sem(0);
+	atomic_int woken(0);
+	atomic_int badSize(0);
+	vector<FiberFuture<int>> results;
+	for (int i = 0; i < 100; i++) {
+		results.emplace_back(pool.submitFiber([&sem, &woken, &badSize](int i) {
+			// ڼִ߳Э̣Эڴеݲᱻ
+			int* buf = ThreadPool::currentWorker()->getArena().allocateArray<int>(16);
+			buf[0] = i;
+			sem.wait();
+			woken++;
+			if (buf[0] != i)
+				badSize++;
+			return i;
+			}, i));
+	}
+	// ȴһЭ̵Ľ
+	FiberFuture<int> first = pool.submitFiber([&sem]() {
+		sem.wait();
+		return 41;
+		});
+	FiberFuture<int> chain = pool.submitFiber([first]() mutable { return first.get() + 1; });
+	pool.submitFiber([&sem]() {
+		for (int i = 0; i < 101; i++) {
+			sem.post();
+		}
+		});
+
+	int sum = 0;
+	for (auto& res : results) {
+		sum += res.get();
+	}
+	bool ok = sum == 4950 && woken == 100 && badSize == 0 && chain.get() == 42;
+	cout << "fiber test: " << (ok ? "ok" : "fail") << endl;
+}
+#endif
+
+// ͬ£ÿƽ(ύ + ִ + ȡ)
+template<typename Pool>
+void benchPool(const char* name)
+{
+	const int count = 200000;
+	Pool pool;
+	pool.setTaskQueMaxThreshHold(count);
+	pool.start(4);
+
+	vector<future<int>> results;
+	results.reserve(count);
+	auto begin = chrono::steady_clock::now();
+	for (int i = 0; i < count; i++) {
+		results.emplace_back(pool.submitTask(sum1, i, 1));
+	}
+	for (auto& res : results) {
+		res.get();
+	}
+	auto dur = chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now() - begin);
+	cout << name << ": " << dur.count() / count << " ns/task" << endl;
+}
+
+// ģһݵļ
+long long parseLine(const string& line)
+{
+	unsigned long long value = stoll(line.substr(line.find(',') + 1));
+	for (int i = 0; i < 200; i++) {
+		value = value * 6364136223846793005ULL + 1442695040888963407ULL; // ޷ǻƣδΪ
+	}
+	return (long long)value;
+}
+
+// ʽļȡ -> () -> ˳ܣԱˮߺÿύһ
+void benchPipeline()
+{
+	const int count = 100000;
+	const char* path = "pipeline_bench.txt";
+	{
+		ofstream out(path);
+		for (int i = 0; i < count; i++) {
+			out << i << "," << i * 7 << "\n";
+		}
+	}
+
+	BasicThreadPool<FixedSize> pool;
+	pool.setTaskQueMaxThreshHold(count);
+	pool.start(4);
+
+	// ÿύһ񣬶˳
+	{
+		auto begin = chrono::steady_clock::now();
+		ifstream in(path);
+		string line;
+		vector<future<long long>> results;
+		while (getline(in, line)) {
+			results.emplace_back(pool.submitTask(parseLine, line));
+		}
+		long long sum = 0;
+		for (auto& res : results) {
+			sum ^= res.get();
+		}
+		auto dur = chrono::duration_cast<chrono::milliseconds>(chrono::steady_clock::now() - begin);
+		cout << "submit per line: " << dur.count() << " ms (" << sum << ")" << endl;
+	}
+
+	// ˮߣȡͽͬʱУͨн
+	{
+		auto begin = chrono::steady_clock::now();
+		ifstream in(path);
+		long long sum = 0;
+		auto pipeline = makePipeline<string>(pool)
+			.then(StageMode::PARALLEL, [](string line) { return parseLine(line); })
+			.then(StageMode::SERIAL_IN_ORDER, [&](long long value) { sum ^= value; });
+		pipeline.run([&](string& line) { return bool(getline(in, line)); }).wait();
+		auto dur = chrono::duration_cast<chrono::milliseconds>(chrono::steady_clock::now() - begin);
+		cout << "pipeline: " << dur.count() << " ms (" << sum << ")" << endl;
+	}
+	remove(path);
+}
+
+#ifdef __linux__
+void benchFiber()
+{
+	const int count = 100000;
+
+	// ֱлģһresume + suspendл
+	{
+		FiberStackPool stacks(FIBER_STACK_SIZE, 1);
+		void* stack = stacks.allocate();
+		Fiber fiber([&]() {
+			for (int i = 0; i < count; i++) {
+				Fiber::current()->suspend(nullptr);
+			}
+			}, stack, stacks.getStackSize(), nullptr);
+		auto begin = chrono::steady_clock::now();
+		while (!fiber.resume());
+		auto dur = chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now() - begin);
+		cout << "fiber switch: " << dur.count() / (count * 2 + 1) << " ns" << endl;
+		stacks.release(stack);
+	}
+
+	// ЭͨźػѣÿλѶ
+	{
+		BasicThreadPool<FixedSize> pool;
+		pool.start(1);
+		FiberSemaphore ping(0), pong(0);
+		auto begin = chrono::steady_clock::now();
+		pool.submitFiber([&]() {
+			for (int i = 0; i < count; i++) {
+				ping.post();
+				pong.wait();
+			}
+			});
+		pool.submitFiber([&]() {
+			for (int i = 0; i < count; i++) {
+				ping.wait();
+				pong.post();
+			}
+			}).get();
+		auto dur = chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now() - begin);
+		cout << "fiber ping-pong through pool: " << dur.count() / (count * 2) << " ns" << endl;
+	}
+}
+#endif
+
+// ÿʹһʱȽÿnewʹ߳ڴ
+template<typename Alloc>
+void benchScratch(const char* name, Alloc alloc)
+{
+	const int count = 200000;
+	BasicThreadPool<FixedSize, RingQueue, SpinThenPark> pool;
+	pool.setTaskQueMaxThreshHold(count);
+	pool.start(4);
+	atomic_llong sum(0);
+	auto begin = chrono::steady_clock::now();
+	vector<future<void>> results;
+	results.reserve(count);
+	for (int i = 0; i < count; i++) {
+		results.emplace_back(pool.submitTask([&sum, alloc, i]() {
+			alloc([&](char* buf, size_t size) {
+				buf[0] = (char)i;
+				buf[size - 1] = (char)i;
+				sum += buf[0] + buf[size - 1];
+				});
+			}));
+	}
+	for (auto& res : results) {
+		res.get();
+	}
+	auto dur = chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now() - begin);
+	cout << name << ": " << dur.count() / count << " ns/task (" << sum << ")" << endl;
+}
+
+void benchWorker()
+{
+	const size_t size = 16 * 1024;
+	benchScratch("scratch new[]", [](function<void(char*, size_t)> use) {
+		unique_ptr<char[]> buf(new char[size]);
+		use(buf.get(), size);
+		});
+	benchScratch("scratch arena", [](function<void(char*, size_t)> use) {
+		use(ThreadPool::currentWorker()->getArena().allocateArray<char>(size), size);
+		});
+}
+
+// дһݺύύһ
+// next߽ͬһִ߳У
+void benchHandoff(bool isNextSlot)
+{
+	const int rounds = 20000;
+	const size_t size = 32 * 1024;
+	BasicThreadPool<FixedSize> pool;
+	pool.setNextSlot(isNextSlot);
+	pool.start(4);
+
+	vector<int> data(size / sizeof(int));
+	atomic_llong latency(0);
+	atomic_llong sum(0);
+	promise<void> done;
+	function<void(int)> produce;
+	auto consume = [&](int round, chrono::steady_clock::time_point submitTime) {
+		latency += chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now() - submitTime).count();
+		long long s = 0;
+		for (int v : data) {
+			s += v;
+		}
+		sum += s;
+		if (round + 1 == rounds)
+			done.set_value();
+		else
+			pool.submitTask(produce, round + 1);
+	};
+	produce = [&](int round) {
+		for (size_t i = 0; i < data.size(); i++) {
+			data[i] = (int)i + round;
+		}
+		pool.submitTask(consume, round, chrono::steady_clock::now());
+	};
+
+	auto begin = chrono::steady_clock::now();
+	pool.submitTask(produce, 0);
+	done.get_future().wait();
+	auto dur = chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now() - begin);
+	cout << "handoff " << (isNextSlot ? "next slot" : "task queue") << ": " << dur.count() / rounds
+		<< " ns/round, latency " << latency / rounds << " ns (" << sum << ")" << endl;
+}
+
+void benchPolicies()
+{
+	benchPool<ThreadPool>("ThreadPool");
+	benchPool<BasicThreadPool<FixedSize>>("FixedSize, FifoQueue, BlockingWait");
+	benchPool<BasicThreadPool<FixedSize, RingQueue>>("FixedSize, RingQueue, BlockingWait");
+	benchPool<BasicThreadPool<FixedSize, RingQueue, SpinThenPark>>("FixedSize, RingQueue, SpinThenPark");
+	benchPool<BasicThreadPool<CachedSize, RingQueue, SpinThenPark>>("CachedSize, RingQueue, SpinThenPark");
+}
+
 int main()
 {
 	ThreadPool pool;
@@ -25,5 +804,27 @@ int main()
 	cout << r2.get() << endl;
 	cout << r3.get() << endl;
 
+	testResize();
+	testBlocking();
+	testTrace();
+	testShared();
+	testTenant();
+	testWorker();
+	testNextSlot();
+	testPipeline();
+#ifdef __linux__
+	testReactor();
+	testFiber();
+#endif
+
+	benchPolicies();
+	benchPipeline();
+	benchWorker();
+	benchHandoff(false);
+	benchHandoff(true);
+#ifdef __linux__
+	benchFiber();
+#endif
+
 	return 0;
-}
\ No newline at end of file
+}
@@ -12,10 +12,31 @@
 #include <unordered_map>
 #include <thread>
 #include <future>
+#include <algorithm>
+#include <chrono>
+#include <string>
+#include <typeindex>
+#include "reactor.h"
+#include "fiber.h"
+#include "worker.h"
+
+// ̳߳صĵTHREADPOOL_NO_LOGر
+#ifndef THREADPOOL_NO_LOG
+#define THREADPOOL_LOG(msg) (std::cout << msg << std::endl)
+#else
+#define THREADPOOL_LOG(msg) ((void)0)
+#endif
 
 const int TASK_MAX_THRESHHOLD = 1024;
 const int THREAD_MAX_THRESHHOLD = 10;
 const int THREAD_MAX_IDLE_TIME = 10; // λs
+const int SPARE_THREAD_MAX_THRESHHOLD = 64; // ̵߳
+const int TRACE_BUFFER_SIZE = 65536; // ÿ̵߳trace¼С
+const int THREAD_SPIN_COUNT = 2000; // SpinThenPark߳˯ǰ
+const int SHARED_SHARD_SIZE = 16; // submitSharedkeyƬ
+const long long TENANT_QUANTUM = 100000; // ȨΪ1⻧ÿֵõִжȣλns
+const int NEXT_TASK_MAX_RUN = 64; // вʱִ߳еnext
+const int NEXT_TASK_STALL_TIME = 1; // ִ߳һ񳬹ʱ仹û߳̿nextе񣬵λms
 
 // ֵ̳֧߳ģʽ
 enum class PoolMode
@@ -24,6 +45,104 @@ enum class PoolMode
 	MODE_CACHED, // ߳ɶ̬
 };
 
+/*
+̳߳صıڲԣBasicThreadPool<SizePolicy, QueuePolicy, IdlePolicy>
+ҪĹڱھͱȥFixedSize̳߳زʱӣҲά߳
+example:
+BasicThreadPool<FixedSize, RingQueue, SpinThenPark> pool;
+pool.start(4);
+*/
+
+// ߳ԣsetModeʱģʽThreadPoolĬϲ
+struct RuntimeMode
+{
+	static constexpr bool canGrow() { return true; } // Ƿܴ߳
+	static bool isCached(PoolMode mode) { return mode == PoolMode::MODE_CACHED; }
+};
+
+// ߳ԣ̶̣߳setModeЧ
+struct FixedSize
+{
+	static constexpr bool canGrow() { return false; }
+	static constexpr bool isCached(PoolMode) { return false; }
+};
+
+// ߳ԣ߳ɶ̬setModeЧ
+struct CachedSize
+{
+	static constexpr bool canGrow() { return true; }
+	static constexpr bool isCached(PoolMode) { return true; }
+};
+
+// λʵֵĶУ֮ÿӶڴ
+template<typename T>
+class RingBuffer
+{
+public:
+	RingBuffer()
+		: buffer_(16)
+		, head_(0)
+		, size_(0)
+	{}
+
+	void push(T&& value)
+	{
+		if (size_ == buffer_.size()) {
+			// Ԫذ˳ᵽµĻ
+			std::vector<T> buffer(buffer_.size() * 2);
+			for (size_t i = 0; i < size_; i++) {
+				buffer[i] = std::move(buffer_[(head_ + i) % buffer_.size()]);
+			}
+			buffer_.swap(buffer);
+			head_ = 0;
+		}
+		buffer_[(head_ + size_) % buffer_.size()] = std::move(value);
+		size_++;
+	}
+
+	T& front() { return buffer_[head_]; }
+
+	void pop()
+	{
+		buffer_[head_] = T(); // ʱͷԪسеԴ
+		head_ = (head_ + 1) % buffer_.size();
+		size_--;
+	}
+
+	size_t size() const { return size_; }
+	bool empty() const { return size_ == 0; }
+private:
+	std::vector<T> buffer_;
+	size_t head_; // ͷ±
+	size_t size_; // Ԫظ
+};
+
+// вԣstd::queueĬϲ
+struct FifoQueue
+{
+	template<typename T>
+	using Queue = std::queue<T>;
+};
+
+// вԣλ
+struct RingQueue
+{
+	template<typename T>
+	using Queue = RingBuffer<T>;
+};
+
+// вԣûʱֱ˯ߣĬϲ
+struct BlockingWait
+{
+	static constexpr int spinCount() { return 0; }
+};
+
+// вԣûʱһʱ˯ߣܼʱ̵߳˯ߺͻ
+struct SpinThenPark
+{
+	static constexpr int spinCount() { return THREAD_SPIN_COUNT; }
+};
+
 // ߳
 class Thread
 {
@@ -31,9 +150,9 @@ public:
 	// ̺߳
 	using ThreadFunc = std::function<void(int)>;
 
-	Thread(ThreadFunc func)
+	Thread(ThreadFunc func, int threadId)
 		:func_(func)
-		, threadId_(generateId_++)
+		, threadId_(threadId)
 	{}
 	~Thread() = default;
 
@@ -52,31 +171,111 @@ public:
 	}
 private:
 	ThreadFunc func_;
-	static int generateId_;
-	int threadId_; // ߳id
+	int threadId_; // ߳id̳߳ط
+
+};
 
+
+// һtrace¼ʱΪsteady_clock
+struct TraceEvent
+{
+	const char* label; // ƣΪnullptrʱʾΪtask
+	long long submitTime; // ύʱ
+	long long startTime; // ʼִʱ
+	long long endTime; // ִнʱ
 };
 
-int Thread::generateId_ = 0;
+// ⻧ͳϢֻж⻧ʱͳ
+struct TenantStats
+{
+	int queueSize; // Ŷӵ
+	unsigned long long startedSize; // Ѿʼִе
+	unsigned long long rejectedSize; // ύʧܵ
+	double avgWaitTime; // ƽŶʱ䣬λms
+	double maxWaitTime; // Ŷʱ䣬λms
+	double runTime; // ۼִʱ䣬λms
+};
 
+// ÿ̶߳ռtraceǰãдµ¼
+// ֻ̻߳ддһ¼size_dumpʱȡsize_֮ǰ¼
+class TraceBuffer
+{
+public:
+	TraceBuffer(int threadId, size_t capacity)
+		: threadId_(threadId)
+		, capacity_(capacity)
+		, events_(new TraceEvent[capacity])
+		, size_(0)
+		, dropped_(0)
+	{}
+
+	void record(const TraceEvent& event)
+	{
+		size_t size = size_.load(std::memory_order_relaxed);
+		if (size == capacity_) {
+			dropped_.fetch_add(1, std::memory_order_relaxed);
+			return;
+		}
+		events_[size] = event;
+		size_.store(size + 1, std::memory_order_release);
+	}
+
+	int getThreadId() const { return threadId_; }
+	size_t size() const { return size_.load(std::memory_order_acquire); }
+	size_t dropped() const { return dropped_.load(std::memory_order_relaxed); }
+	const TraceEvent& operator[](size_t index) const { return events_[index]; }
+private:
+	int threadId_;
+	size_t capacity_;
+	std::unique_ptr<TraceEvent[]> events_;
+	std::atomic<size_t> size_;
+	std::atomic<size_t> dropped_;
+};
 
 // ̳߳
-class ThreadPool
+template<typename SizePolicy = RuntimeMode, typename QueuePolicy = FifoQueue, typename IdlePolicy = BlockingWait>
+class BasicThreadPool
 {
 public:
-	ThreadPool()
+	BasicThreadPool()
 		: initThreadSize_(4)
-		, taskSize_(0)
-		, taskQueMaxThreshHold_(TASK_MAX_THRESHHOLD)
+		, curThreadSize_(0)
+		, idleThreadSize_(0)
 		, threadSizeThreshHold_(THREAD_MAX_THRESHHOLD)
+		, isFairQueue_(false)
+		, drrIndex_(0)
+		, taskSize_(0)
 		, poolMode_(PoolMode::MODE_FIXED)
 		, isPoolRunning_(false)
-		, idleThreadSize_(0)
-		, curThreadSize_(0)
-	{}
+		, threadMaxIdleTime_(THREAD_MAX_IDLE_TIME)
+		, retireThreadSize_(0)
+		, generateId_(0)
+		, isNextSlotEnabled_(true)
+		, nextTaskSize_(0)
+		, waitThreadSize_(0)
+		, isStallWatching_(false)
+		, blockedThreadSize_(0)
+		, spareThreadSize_(0)
+		, spareThreadSizeThreshHold_(SPARE_THREAD_MAX_THRESHHOLD)
+		, isTraceEnabled_(false)
+		, traceGeneration_(0)
+		, traceBufferSize_(TRACE_BUFFER_SIZE)
+		, traceEpoch_(0)
+		, sharedCacheTime_(0)
+		, sharedCacheSize_(0)
+		, sharedDoneSize_(0)
+	{
+		// ⻧0Ĭ⻧submitTaskύ񶼷Ķ
+		tenants_.emplace_back(std::make_unique<Tenant>(1, TASK_MAX_THRESHHOLD));
+	}
 
-	~ThreadPool()
+	~BasicThreadPool()
 	{
+#ifdef __linux__
+		// ַֹͣfd¼ѾеĻصִ߳
+		if (reactor_ != nullptr)
+			reactor_->stop();
+#endif
 		isPoolRunning_ = false;
 
 		// ȴ̷̳߳߳  ״̬ | ִ
@@ -88,58 +287,141 @@ public:
 	// ̳߳
 	void start(int initThreadSize = std::thread::hardware_concurrency())
 	{
+		std::unique_lock<std::mutex> lock(taskQueMtx_);
+
 		// ̳߳ص״̬
 		isPoolRunning_ = true;
 
 		// ¼ʼ̸߳
 		initThreadSize_ = initThreadSize;
-		curThreadSize_ = initThreadSize;
 
-		// ̶߳
+		// ̣߳߳id̳߳Լ䣬±threads_
 		for (size_t i = 0; i < initThreadSize_; i++) {
-			// thread̶߳ʱ򣬰̺߳thread̶߳
-			auto ptr = std::make_unique<Thread>(std::bind(&ThreadPool::threadFunc, this, std::placeholders::_1));
-			int threadId = ptr->getId();
-			threads_.emplace(threadId, std::move(ptr));
-			//threads_.emplace_back(std::move(ptr)); // unique_ptr ûֵ븳ֵ
+			createThread();
 		}
+	}
 
-		// ߳
-		for (size_t i = 0; i < initThreadSize_; i++) {
-			threads_[i]->start();
-			idleThreadSize_++; // ¼ʼ̵߳
+	// е̳߳ص(ʼ)߳Ҫֹ̳ͣ߳
+	// ʱϴ̣߳Сʱִ߳ϵ˳
+	void setThreadSize(int size)
+	{
+		if (size <= 0)
+			return;
+		std::unique_lock<std::mutex> lock(taskQueMtx_);
+		initThreadSize_ = size;
+		if (!checkRunningState())
+			return;
+
+		// ûյ˳֪ͨ߳ı̲߳
+		int liveSize = curThreadSize_ - retireThreadSize_ - spareThreadSize_;
+		if (liveSize < size) {
+			// ȳûִе˳֪ͨٴ߳
+			int cancel = std::min(retireThreadSize_, size - liveSize);
+			retireThreadSize_ -= cancel;
+			for (liveSize += cancel; liveSize < size; liveSize++) {
+				createThread();
+			}
+		}
+		else if (liveSize > size) {
+			retireThreadSize_ += liveSize - size;
+			notEmpty_.notify_all(); // ѿ߳ȥ˳
 		}
 	}
 
-	// ̳߳عģʽ
+	// ̳߳عģʽҲлֻRuntimeModeЧ
 	void setMode(PoolMode mode)
 	{
-		if (checkRunningState())
-			return;
+		std::unique_lock<std::mutex> lock(taskQueMtx_);
 		poolMode_ = mode;
+		notEmpty_.notify_all(); // ÿ̰߳µģʽµȴ
 	}
 
-	// taskֵ
+	// taskֵҲ޸
 	void setTaskQueMaxThreshHold(int threshhold)
 	{
-		if (checkRunningState())
+		if (threshhold <= 0)
 			return;
-		taskQueMaxThreshHold_ = threshhold;
+		std::unique_lock<std::mutex> lock(taskQueMtx_);
+		tenants_[0]->quota = threshhold;
+		notFull_.notify_all(); // бڵȴύ߿Լ
 	}
 
-	// ̳߳cachedģʽ̵ֵ߳
+	// ̳߳cachedģʽ̵ֵ߳Ҳ޸
 	void setThreadSizeThreshHold(int threshhold)
 	{
-		if (checkRunningState())
-			return;
-		if (poolMode_ == PoolMode::MODE_CACHED)
+		std::unique_lock<std::mutex> lock(taskQueMtx_);
+		if (SizePolicy::isCached(poolMode_))
 			threadSizeThreshHold_ = threshhold;
 	}
 
+	// cachedģʽ¶̵߳ʱ䣬λs
+	void setThreadMaxIdleTime(int seconds)
+	{
+		if (seconds <= 0)
+			return;
+		std::unique_lock<std::mutex> lock(taskQueMtx_);
+		threadMaxIdleTime_ = seconds;
+	}
+
+	// ı߳
+	void setSpareThreadSizeThreshHold(int threshhold)
+	{
+		if (threshhold < 0)
+			return;
+		std::unique_lock<std::mutex> lock(taskQueMtx_);
+		spareThreadSizeThreshHold_ = threshhold;
+	}
+
+	// ȡ̳߳صǰ߳
+	int getThreadSize() const
+	{
+		return curThreadSize_;
+	}
+
+	/*
+	䣺I/O֮ǰ̳߳ػһ̣߳
+	֤߳initThreadSize_߳˳
+	example:
+	pool.submitTask([&pool]() {
+		ThreadPool::BlockingSection section(pool);
+		read(fd, buf, len);
+	});
+	ֻڱ̳߳ص߳Ч߳ʹʲô
+	*/
+	class BlockingSection
+	{
+	public:
+		BlockingSection(BasicThreadPool& pool)
+			: pool_(currentPool() == &pool ? &pool : nullptr)
+			, isSpare_(false)
+		{
+			if (pool_ != nullptr)
+				isSpare_ = pool_->beginBlocking();
+		}
+		~BlockingSection()
+		{
+			if (pool_ != nullptr)
+				pool_->endBlocking(isSpare_);
+		}
+
+		BlockingSection(const BlockingSection&) = delete;
+		BlockingSection& operator=(const BlockingSection&) = delete;
+	private:
+		BasicThreadPool* pool_;
+		bool isSpare_; // ǷΪ˱߳
+	};
+
 	// ̳߳ύ
 	// ʹÿɱģ̣submitTaskԽĲ
 	template<typename Func, typename... Args>
 	auto submitTask(Func&& func, Args&&... args) -> std::future<decltype(func(args...))> // Ƶķֵ
+	{
+		return submitNamedTask(nullptr, std::forward<Func>(func), std::forward<Args>(args)...);
+	}
+
+	// ύƵֻtraceʹãҪַ㹻ַ
+	template<typename Func, typename... Args>
+	auto submitNamedTask(const char* label, Func&& func, Args&&... args) -> std::future<decltype(func(args...))>
 	{
 		// 񣬷
 		using RType = decltype(func(args...));
@@ -147,51 +429,314 @@ public:
 			std::bind(std::forward<Func>(func), std::forward<Args>(args)...));
 		std::future<RType> result = task->get_future();
 
-		// ȡ
-		std::unique_lock<std::mutex> lock(taskQueMtx_);
+		if (!enqueueTask([task]() { (*task)(); }, label)) {
+			auto task = std::make_shared<std::packaged_task<RType()>>(
+				[]()->RType { return RType(); }); // طֵͶӦֵ
+			(*task)();
+			return task->get_future();
+		}
 
-		// ûύ1sжύʧܣ
-		if (!notFull_.wait_for(lock, std::chrono::seconds(1),
-			[&]()->bool {return taskQue_.size() < (size_t)taskQueMaxThreshHold_; })) {
-			// ʾnotFull_ȴ1sȻû
-			std::cerr << "task queue is full, submit task fail." << std::endl;
+		// Result
+		return result;
+	}
+
+	// ύĳ⻧⻧ʱȴ1s
+	template<typename Func, typename... Args>
+	auto submitTenantTask(int tenantId, Func&& func, Args&&... args) -> std::future<decltype(func(args...))>
+	{
+		using RType = decltype(func(args...));
+		auto task = std::make_shared<std::packaged_task<RType()>>(
+			std::bind(std::forward<Func>(func), std::forward<Args>(args)...));
+		std::future<RType> result = task->get_future();
+
+		if (!enqueueTask([task]() { (*task)(); }, nullptr, tenantId)) {
 			auto task = std::make_shared<std::packaged_task<RType()>>(
 				[]()->RType { return RType(); }); // طֵͶӦֵ
 			(*task)();
 			return task->get_future();
 		}
+		return result;
+	}
 
-		// п࣬
-		//taskQue_.emplace(sp);
-		taskQue_.emplace([task]() {
+	/*
+	ύͬkeyʱϲִУkeyӦڶлִʱֱӷĽظύ
+	setSharedCacheִĽttlʱҲֱӷ
+	example:
+	std::shared_future<std::string> value = pool.submitShared("user:42", loadUser, 42);
+	ͬһkeyҪͬķֵͣͬ
+	*/
+	template<typename Func, typename... Args>
+	auto submitShared(const std::string& key, Func&& func, Args&&... args) -> std::shared_future<decltype(func(args...))>
+	{
+		using RType = decltype(func(args...));
+		SharedShard& shard = sharedShards_[std::hash<std::string>()(key) % SHARED_SHARD_SIZE];
+		auto call = std::bind(std::forward<Func>(func), std::forward<Args>(args)...);
+		auto isCancelled = std::make_shared<bool>(false);
+		auto task = std::make_shared<std::packaged_task<RType()>>(
+			[call, isCancelled]() mutable -> RType {
+				if (*isCancelled)
+					return RType(); // ύʧܣطֵͶӦֵ
+				return call();
+			});
+		std::shared_future<RType> result = task->get_future().share();
+		{
+			std::unique_lock<std::mutex> lock(shard.mtx);
+			auto it = shard.flights.find(key);
+			if (it != shard.flights.end() && it->second.type == typeid(RType)) {
+				SharedFlight& flight = it->second;
+				if (!flight.isDone || std::chrono::steady_clock::now() < flight.expireTime)
+					return *std::static_pointer_cast<std::shared_future<RType>>(flight.result);
+				shard.flights.erase(it); // Ľ
+				shard.doneSize--;
+				sharedDoneSize_--;
+			}
+			else if (it != shard.flights.end()) {
+				// ֵͲͬϲֱύ
+				lock.unlock();
+				return submitTask(call).share();
+			}
+			shard.flights.emplace(key, SharedFlight{ std::make_shared<std::shared_future<RType>>(result),
+				typeid(RType), task.get(), false, std::chrono::steady_clock::time_point() });
+		}
+
+		if (!enqueueTask([this, &shard, key, task]() {
 			(*task)();
+			finishShared(shard, key, task.get());
+			}, nullptr)) {
+			// ύʧܣֵܵ
+			*isCancelled = true;
+			(*task)();
+			cancelShared(shard, key, task.get());
+		}
+		return result;
+	}
+
+	// submitSharedĻʱ(λms)keyһ໺ĽttlΪ0ʱ
+	void setSharedCache(int ttl, int maxSize)
+	{
+		sharedCacheTime_ = std::max(ttl, 0);
+		sharedCacheSize_ = std::max(maxSize, 0);
+	}
+
+	// ύBlockingSectionִ
+	template<typename Func, typename... Args>
+	auto submitBlocking(Func&& func, Args&&... args) -> std::future<decltype(func(args...))>
+	{
+		using RType = decltype(func(args...));
+		auto call = std::bind(std::forward<Func>(func), std::forward<Args>(args)...);
+		return submitTask([this, call]() mutable -> RType {
+			BlockingSection section(*this);
+			return call();
 			});
-		taskSize_++;
+	}
 
-		// вգ֪ͨnotEmpty_
-		notEmpty_.notify_all();
+	/*
+	̶߳æʱֱύִ߳УsubmitTaskһ
+	ֻʺִʱ̵ܶʡȥŶӺл̵߳Ŀлѹ߳ʱΪ̶߳æ
+	*/
+	template<typename Func, typename... Args>
+	auto submitInlineIfBusy(Func&& func, Args&&... args) -> std::future<decltype(func(args...))>
+	{
+		if (taskSize_ < (unsigned)curThreadSize_)
+			return submitTask(std::forward<Func>(func), std::forward<Args>(args)...);
 
-		// cachedģʽСȽϽ
-		// ҪͿ߳жǷҪµ߳
-		if (poolMode_ == PoolMode::MODE_CACHED && taskSize_ > idleThreadSize_ && curThreadSize_ < threadSizeThreshHold_) {
-			std::cout << ">>>create new thread" << std::endl;
-			// µthread̶߳
-			auto ptr = std::make_unique<Thread>(std::bind(&ThreadPool::threadFunc, this, std::placeholders::_1));
-			int threadId = ptr->getId();
-			threads_.emplace(threadId, std::move(ptr));
-			//threads_.emplace_back(std::move(ptr)); // unique_ptr ûֵ븳ֵ
-			threads_[threadId]->start(); // ߳
-			curThreadSize_++;
-			idleThreadSize_++;
+		using RType = decltype(func(args...));
+		std::packaged_task<RType()> task(std::bind(std::forward<Func>(func), std::forward<Args>(args)...));
+		std::future<RType> result = task.get_future();
+		task();
+		return result;
+	}
+
+	// Ƿִ߳ʱύnext(ĬϿ)رպ񶼰ύ˳
+	void setNextSlot(bool isEnabled)
+	{
+		isNextSlotEnabled_ = isEnabled;
+	}
+
+	// ǰ̵߳(߳±ꡢڴءֲ߳̾洢)̳߳ص߳ʱnullptr
+	// Э̹߳ϼִУǰȡĿܲͬЭgetArenaõЭԼڴأԿʹ
+	static WorkerContext* currentWorker()
+	{
+		return WorkerContext::current();
+	}
+
+	// һ⻧⻧id
+	// weightΪȨأʱ⻧Ȩط̵ִ߳ʱ䣻quotaΪ⻧е
+	// ⻧0Ĭ⻧submitTaskύ⻧0
+	int addTenant(int weight = 1, int quota = TASK_MAX_THRESHHOLD)
+	{
+		std::unique_lock<std::mutex> lock(taskQueMtx_);
+		tenants_.emplace_back(std::make_unique<Tenant>(std::max(weight, 1), std::max(quota, 1)));
+		isFairQueue_ = true;
+		return (int)tenants_.size() - 1;
+	}
+
+	// ޸⻧ȨغޣҲ޸
+	void setTenant(int tenantId, int weight, int quota)
+	{
+		std::unique_lock<std::mutex> lock(taskQueMtx_);
+		if (tenantId < 0 || tenantId >= (int)tenants_.size())
+			return;
+		tenants_[tenantId]->weight = std::max(weight, 1);
+		tenants_[tenantId]->quota = std::max(quota, 1);
+		notFull_.notify_all();
+	}
+
+	// ȡ⻧ͳϢ
+	TenantStats getTenantStats(int tenantId)
+	{
+		std::unique_lock<std::mutex> lock(taskQueMtx_);
+		TenantStats stats{};
+		if (tenantId < 0 || tenantId >= (int)tenants_.size())
+			return stats;
+		Tenant& tenant = *tenants_[tenantId];
+		stats.queueSize = (int)tenant.taskQue.size();
+		stats.startedSize = tenant.startedSize;
+		stats.rejectedSize = tenant.rejectedSize;
+		stats.avgWaitTime = tenant.startedSize > 0 ? tenant.waitTime / 1e6 / tenant.startedSize : 0;
+		stats.maxWaitTime = tenant.maxWaitTime / 1e6;
+		stats.runTime = tenant.runTime / 1e6;
+		return stats;
+	}
+
+	// trace¼ÿύʼʱִ߳
+	// capacityΪÿ߳¼¼ٴο֮ǰļ¼
+	void enableTrace(size_t capacity = TRACE_BUFFER_SIZE)
+	{
+		size_t workerSize = 0;
+		{
+			std::unique_lock<std::mutex> lock(taskQueMtx_);
+			workerSize = workers_.size();
+		}
+		// е߳±仺֮±߳ʱԼ
+		std::vector<std::shared_ptr<TraceBuffer>> buffers;
+		for (size_t i = 0; i < workerSize; i++) {
+			buffers.push_back(std::make_shared<TraceBuffer>((int)i, capacity));
 		}
 
-		// Result
+		std::unique_lock<std::mutex> lock(traceMtx_);
+		traceBuffers_.swap(buffers);
+		traceBufferSize_ = capacity;
+		traceEpoch_ = steadyNow();
+		traceGeneration_++;
+		isTraceEnabled_ = true;
+	}
+
+	// رtraceѾ¼¼һenableTrace
+	void disableTrace()
+	{
+		isTraceEnabled_ = false;
+	}
+
+	// Chrome Trace Eventʽtracechrome://tracingPerfetto鿴
+	void dumpTrace(std::ostream& out)
+	{
+		std::unique_lock<std::mutex> lock(traceMtx_);
+		std::ios::fmtflags flags = out.flags();
+		std::streamsize precision = out.precision(3); // ʱ䵥λΪusns
+		out.setf(std::ios::fixed, std::ios::floatfield);
+		out << "{\"traceEvents\":[";
+		bool first = true;
+		for (auto& item : traceBuffers_) {
+			if (item == nullptr)
+				continue;
+			const TraceBuffer& buffer = *item;
+			int tid = buffer.getThreadId();
+			out << (first ? "" : ",") << "\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << tid
+				<< ",\"args\":{\"name\":\"worker " << tid << "\"}}";
+			first = false;
+
+			size_t size = buffer.size();
+			for (size_t i = 0; i < size; i++) {
+				const TraceEvent& event = buffer[i];
+				out << ",\n{\"name\":\"" << escapeJson(event.label != nullptr ? event.label : "task")
+					<< "\",\"cat\":\"task\",\"ph\":\"X\",\"pid\":1,\"tid\":" << tid
+					<< ",\"ts\":" << (event.startTime - traceEpoch_) / 1000.0
+					<< ",\"dur\":" << (event.endTime - event.startTime) / 1000.0
+					<< ",\"args\":{\"wait_us\":" << (event.startTime - event.submitTime) / 1000.0 << "}}";
+			}
+			if (buffer.dropped() > 0) {
+				std::cerr << "trace buffer of thread " << tid << " is full, "
+					<< buffer.dropped() << " events dropped." << std::endl;
+			}
+		}
+		out << "\n],\"displayTimeUnit\":\"ms\"}" << std::endl;
+		out.flags(flags);
+		out.precision(precision);
+	}
+
+#ifdef __linux__
+	// fdɶʱִ̳߳handler(fd)fdΪԵhandlerҪEAGAINΪֹ
+	// ͬһfdͬʱֻһhandlerִ
+	bool onReadable(int fd, Reactor::Handler handler)
+	{
+		return getReactor().onReadable(fd, std::move(handler));
+	}
+
+	// fdдʱִ̳߳handler(fd)fdΪԵ
+	bool onWritable(int fd, Reactor::Handler handler)
+	{
+		return getReactor().onWritable(fd, std::move(handler));
+	}
+
+	// ټfdرfd֮ǰҪ
+	void removeFd(int fd)
+	{
+		getReactor().remove(fd);
+	}
+
+	/*
+	ύЭִееȴFiberFutureFiberSemaphoreʱЭ̡ọ́߳ԼִʱٷŻ
+	example:
+	FiberFuture<int> sub = pool.submitFiber(func1);
+	pool.submitFiber([sub]() mutable { return sub.get() + 1; }); // getռס߳
+	Эеȴstd::futurestd::mutexȻ̣߳Эջʱֱִ߳
+	*/
+	template<typename Func, typename... Args>
+	auto submitFiber(Func&& func, Args&&... args) -> FiberFuture<decltype(func(args...))>
+	{
+		using RType = decltype(func(args...));
+		auto task = std::make_shared<std::packaged_task<RType()>>(
+			std::bind(std::forward<Func>(func), std::forward<Args>(args)...));
+		auto done = std::make_shared<FiberSemaphore>(0);
+		FiberFuture<RType> result(task->get_future().share(), done);
+
+		if (!enqueueTask([this, task, done]() {
+			runFiber([task, done]() {
+				(*task)();
+				done->post();
+				});
+			}, "fiber")) {
+			auto task = std::make_shared<std::packaged_task<RType()>>(
+				[]()->RType { return RType(); }); // طֵͶӦֵ
+			(*task)();
+			done->post();
+			return FiberFuture<RType>(task->get_future().share(), done);
+		}
 		return result;
 	}
 
-	ThreadPool(const ThreadPool&) = delete;
-	ThreadPool& operator=(const ThreadPool&) = delete;
+	// ЭջĴС(λֽ)ޣЭջռõڴ治size * maxSize
+	// ҪڵһsubmitFiber֮ǰãֻһ
+	void setFiberStack(size_t size, int maxSize)
+	{
+		bool isSet = false;
+		std::call_once(fiberStacksOnce_, [&]() {
+			fiberStacks_ = std::make_unique<FiberStackPool>(size, std::max(maxSize, 1));
+			isSet = true;
+			});
+		if (!isSet)
+			std::cerr << "fiber stacks are in use, set fiber stack fail." << std::endl;
+	}
+#endif
+
+	BasicThreadPool(const BasicThreadPool&) = delete;
+	BasicThreadPool& operator=(const BasicThreadPool&) = delete;
 private:
+	// ˮ߽׶εͨdispatchBatchύ
+	template<typename Pool>
+	friend class PipelineCore;
+
 	std::unordered_map<int, std::unique_ptr<Thread>> threads_;
 
 	size_t initThreadSize_; // ʼ߳
@@ -200,9 +745,46 @@ private:
 	int threadSizeThreshHold_; // ֵ߳
 
 	using Task = std::function<void()>;
-	std::queue<Task> taskQue_; // 
-	std::atomic_uint taskSize_; // 
-	int taskQueMaxThreshHold_; // ֵ
+	struct Tenant;
+	// еԪأlabelsubmitTimeֻtraceж⻧ʱʹ
+	struct TaskItem
+	{
+		Task task;
+		const char* label;
+		long long submitTime;
+		Tenant* tenant; // ⻧
+	};
+
+	// ⻧ÿ⻧Լкޣ̰߳ȨشӸ⻧Ķȡ
+	struct Tenant
+	{
+		Tenant(int weight, int quota)
+			: weight(weight)
+			, quota(quota)
+			, deficit(0)
+			, rejectedSize(0)
+			, startedSize(0)
+			, waitTime(0)
+			, maxWaitTime(0)
+			, runTime(0)
+		{}
+
+		typename QueuePolicy::template Queue<TaskItem> taskQue; // 
+		int weight; // Ȩ
+		int quota; // ֵ⻧0ľsetTaskQueMaxThreshHoldõֵ
+		std::atomic<long long> deficit; // DRRʣִжȣλnsִ۳ʵʵִʱ
+
+		unsigned long long rejectedSize; // ͳϢڻȡtaskQueMtx_޸
+		unsigned long long startedSize;
+		long long waitTime;
+		long long maxWaitTime;
+		std::atomic<long long> runTime; // ִۼ
+	};
+	std::vector<std::unique_ptr<Tenant>> tenants_; // ⻧Ӻ󲻻ɾ
+	std::atomic_bool isFairQueue_; // Ƿж⻧ֻһ⻧ʱҪѯͳ
+	size_t drrIndex_; // DRRѯ⻧±
+
+	std::atomic_uint taskSize_; // ⻧
 
 	std::mutex taskQueMtx_; // ֤е̰߳ȫ
 	std::condition_variable notFull_; // ʾв
@@ -213,88 +795,634 @@ private:
 
 	std::atomic_bool isPoolRunning_; // ¼ǰ̳߳صĹ״̬
 
+	int threadMaxIdleTime_; // cachedģʽ¶̵߳ʱ
+	int retireThreadSize_; // Ҫ˳߳setThreadSizeСʱ
+	int generateId_; // ߳idÿ̳߳ص
+	std::vector<WorkerContext*> workers_; // ±̵߳ģ߳˳Ϊnullptr±̸߳
+
+	std::atomic_bool isNextSlotEnabled_; // Ƿʹnext
+	int nextTaskSize_; // next߳
+	int waitThreadSize_; // ˯ߵȴ߳
+	bool isStallWatching_; // Ƿп߳ڼnext۵ûпס
+
+	int blockedThreadSize_; // ߳
+	int spareThreadSize_; // Ϊ̲߳ı߳
+	int spareThreadSizeThreshHold_; // ֵ߳
+
+	std::atomic_bool isTraceEnabled_; // Ƿtrace
+	std::atomic<unsigned> traceGeneration_; // ÿenableTraceһ߳̾ݴ˸»Ļ
+	size_t traceBufferSize_; // ÿ߳traceĴС
+	long long traceEpoch_; // traceʼʱ
+	// ߳±ŵtrace±긴ʱҲã̻߳һãenableTrace滻ʱͷдĻ
+	std::vector<std::shared_ptr<TraceBuffer>> traceBuffers_;
+	std::mutex traceMtx_; // trace״̬йһ
+
+	// steady_clocktrace⻧ʱͳ
+	static long long steadyNow()
+	{
+		return std::chrono::duration_cast<std::chrono::nanoseconds>(
+			std::chrono::steady_clock::now().time_since_epoch()).count();
+	}
+
+	// traceʱ̵߳±仺taskQueMtx_֮
+	void allocTraceBuffer(int index)
+	{
+		if (!isTraceEnabled_)
+			return;
+		size_t capacity = 0;
+		{
+			std::unique_lock<std::mutex> lock(traceMtx_);
+			if (index < (int)traceBuffers_.size() && traceBuffers_[index] != nullptr)
+				return;
+			capacity = traceBufferSize_;
+		}
+		std::shared_ptr<TraceBuffer> buffer = std::make_shared<TraceBuffer>(index, capacity);
+
+		std::unique_lock<std::mutex> lock(traceMtx_);
+		if (index >= (int)traceBuffers_.size())
+			traceBuffers_.resize(index + 1);
+		if (traceBuffers_[index] == nullptr)
+			traceBuffers_[index] = std::move(buffer);
+	}
+
+	// ִ񲢼¼trace¼enableTrace֮һִʱ̻߳Ļ
+	void runTraced(TaskItem& item, int index, std::shared_ptr<TraceBuffer>& trace, unsigned& generation)
+	{
+		if (generation != traceGeneration_.load(std::memory_order_acquire)) {
+			std::unique_lock<std::mutex> lock(traceMtx_);
+			generation = traceGeneration_;
+			trace = index < (int)traceBuffers_.size() ? traceBuffers_[index] : nullptr;
+		}
+		long long startTime = steadyNow();
+		// trace֮ǰύûύʱ
+		TraceEvent event{ item.label, item.submitTime != 0 ? item.submitTime : startTime, startTime, 0 };
+		if (item.task != nullptr)
+			item.task(); // ִfunction<void()>
+		event.endTime = steadyNow();
+		if (trace != nullptr)
+			trace->record(event);
+	}
+
+	static std::string escapeJson(const char* str)
+	{
+		std::string result;
+		for (; *str != '\0'; str++) {
+			if (*str == '"' || *str == '\\')
+				result += '\\';
+			if ((unsigned char)*str >= 0x20)
+				result += *str;
+		}
+		return result;
+	}
+
+	// submitSharedһkeyӦ
+	struct SharedFlight
+	{
+		std::shared_ptr<void> result; // std::shared_future<RType>
+		std::type_index type; // ķֵ
+		const void* owner; // ύpackaged_taskʶǲͬһִ
+		bool isDone; // Ѿִ꣬ڻ
+		std::chrono::steady_clock::time_point expireTime; // Ľڵʱ
+	};
+
+	// keyһƬÿƬtaskQueMtx_
+	struct SharedShard
+	{
+		std::mutex mtx;
+		std::unordered_map<std::string, SharedFlight> flights;
+		size_t doneSize = 0; // Ľ
+	};
+
+	SharedShard sharedShards_[SHARED_SHARD_SIZE];
+	std::atomic_int sharedCacheTime_; // ʱ䣬λms
+	std::atomic_int sharedCacheSize_; // ໺Ľ
+	std::atomic_int sharedDoneSize_; // зƬĽ
+
+	// keyӦִ꣬ɾͼ¼ʱ䲢̭Ľ
+	void finishShared(SharedShard& shard, const std::string& key, const void* owner)
+	{
+		auto now = std::chrono::steady_clock::now();
+		{
+			std::unique_lock<std::mutex> lock(shard.mtx);
+			auto it = shard.flights.find(key);
+			if (it == shard.flights.end() || it->second.owner != owner)
+				return;
+
+			int cacheTime = sharedCacheTime_;
+			if (cacheTime == 0 || sharedCacheSize_ == 0) {
+				shard.flights.erase(it);
+				return;
+			}
+
+			it->second.isDone = true;
+			it->second.expireTime = now + std::chrono::milliseconds(cacheTime);
+			shard.doneSize++;
+			sharedDoneSize_++;
+
+			// ʱ̭ƬĽ
+			while (sharedDoneSize_ > sharedCacheSize_ && evictShared(shard, now));
+		}
+
+		// Ƭ̭˻ޣ̭ƬĽÿֻһƬ
+		for (int i = 0; i < SHARED_SHARD_SIZE && sharedDoneSize_ > sharedCacheSize_; i++) {
+			std::unique_lock<std::mutex> lock(sharedShards_[i].mtx);
+			while (sharedDoneSize_ > sharedCacheSize_ && evictShared(sharedShards_[i], now));
+		}
+	}
+
+	// ̭Ƭеһ̭ڵģ̭ڵģƬûнʱfalse
+	// ǰҪȡshard.mtx
+	bool evictShared(SharedShard& shard, std::chrono::steady_clock::time_point now)
+	{
+		if (shard.doneSize == 0)
+			return false;
+		auto oldest = shard.flights.end();
+		for (auto iter = shard.flights.begin(); iter != shard.flights.end(); ++iter) {
+			if (!iter->second.isDone)
+				continue;
+			if (oldest == shard.flights.end() || iter->second.expireTime < oldest->second.expireTime)
+				oldest = iter;
+			if (oldest->second.expireTime <= now)
+				break;
+		}
+		shard.flights.erase(oldest);
+		shard.doneSize--;
+		sharedDoneSize_--;
+		return true;
+	}
+
+	// ύʧܣɾkeyӦ֮ͬһkeyύ
+	void cancelShared(SharedShard& shard, const std::string& key, const void* owner)
+	{
+		std::unique_lock<std::mutex> lock(shard.mtx);
+		auto it = shard.flights.find(key);
+		if (it != shard.flights.end() && it->second.owner == owner)
+			shard.flights.erase(it);
+	}
+
+#ifdef __linux__
+	std::unique_ptr<Reactor> reactor_; // fd¼ַһעfdʱ
+
+	Reactor& getReactor()
+	{
+		std::unique_lock<std::mutex> lock(taskQueMtx_);
+		if (reactor_ == nullptr) {
+			reactor_ = std::make_unique<Reactor>([this](std::vector<Task>& batch) {
+				dispatchBatch(batch);
+				});
+		}
+		return *reactor_;
+	}
+
+	std::once_flag fiberStacksOnce_;
+	std::unique_ptr<FiberStackPool> fiberStacks_; // ЭջأsetFiberStackߵһִЭʱ֮ٸı
+
+	// ֻ֮call_onceһԭӶ
+	FiberStackPool& getFiberStacks()
+	{
+		std::call_once(fiberStacksOnce_, [this]() {
+			fiberStacks_ = std::make_unique<FiberStackPool>(FIBER_STACK_SIZE, FIBER_STACK_MAX);
+			});
+		return *fiberStacks_;
+	}
+
+	// ߳ϴִһЭ̣Эջʱֱִfunc
+	void runFiber(std::function<void()> func)
+	{
+		FiberStackPool& stacks = getFiberStacks();
+		void* stack = stacks.allocate();
+		if (stack == nullptr) {
+			func();
+			return;
+		}
+		Fiber* fiber = new Fiber(std::move(func), stack, stacks.getStackSize(), [this](Fiber* fiber) {
+			// Э̿ԼִˣŻУ
+			std::vector<Task> batch{ [this, fiber]() { resumeFiber(fiber); } };
+			dispatchBatch(batch, "fiber");
+			});
+		resumeFiber(fiber);
+	}
+
+	// ִЭֱ߹𣬽ʱЭջ
+	// ִڼ̵߳getArenaЭ̵ڴأ̵߳ڴresetܸЭ
+	void resumeFiber(Fiber* fiber)
+	{
+		WorkerContext* worker = WorkerContext::current();
+		WorkerArena* arena = worker->activeArena_;
+		worker->activeArena_ = &fiber->getArena();
+		bool isDone = fiber->resume();
+		worker->activeArena_ = arena; // Э̿Ѿִ߳Уٷfiber
+		if (isDone) {
+			getFiberStacks().release(fiber->getStack());
+			delete fiber;
+		}
+	}
+#endif
+
+	// ⻧Уʱȴ1sʱfalse
+	bool enqueueTask(Task task, const char* label, int tenantId = 0)
+	{
+		long long submitTime = isTraceEnabled_ || isFairQueue_ ? steadyNow() : 0;
+
+		// ȡ
+		std::unique_lock<std::mutex> lock(taskQueMtx_);
+
+		if (tenantId < 0 || tenantId >= (int)tenants_.size()) {
+			std::cerr << "tenant " << tenantId << " is invalid, submit task fail." << std::endl;
+			return false;
+		}
+		Tenant* tenant = tenants_[tenantId].get();
+
+		// ִ߳ʱύnextۣǰͬһִ߳У
+		// ѾʱУУʱύһȴڲ
+		// ж⻧ʱУ֤ƽ
+		WorkerContext* worker = WorkerContext::current();
+		if (isNextSlotEnabled_ && tenantId == 0 && !isFairQueue_ && worker != nullptr && currentPool() == this
+			&& (worker->nextTask_ == nullptr || tenant->taskQue.size() < (size_t)tenant->quota)) {
+			flushNextTask(*worker); // ľУcachedģʽ¿߳
+			worker->nextTask_ = std::move(task);
+			worker->nextLabel_ = label;
+			worker->nextSubmitTime_ = submitTime;
+			nextTaskSize_++;
+			// û߳ڼʱһ˯ߵ߳飬ǰ߳̿סʱ߲е
+			if (!isStallWatching_ && waitThreadSize_ > 0)
+				notEmpty_.notify_one();
+			return true;
+		}
+
+		// ûύ1sжύʧܣ
+		if (!notFull_.wait_for(lock, std::chrono::seconds(1),
+			[&]()->bool {return tenant->taskQue.size() < (size_t)tenant->quota; })) {
+			// ʾnotFull_ȴ1sȻû
+			std::cerr << "task queue is full, submit task fail." << std::endl;
+			tenant->rejectedSize++;
+			return false;
+		}
+
+		// п࣬
+		tenant->taskQue.push(TaskItem{ std::move(task), label, submitTime, tenant });
+		taskSize_++;
+
+		// вգ֪ͨnotEmpty_
+		notEmpty_.notify_all();
+
+		growThread();
+		return true;
+	}
+
+	// cachedģʽСȽϽ
+	// ҪͿ߳жǷҪµ̣߳ǰҪȡtaskQueMtx_
+	void growThread()
+	{
+		if (SizePolicy::isCached(poolMode_) && taskSize_ > idleThreadSize_ && curThreadSize_ < threadSizeThreshHold_) {
+			THREADPOOL_LOG(">>>create new thread");
+			// µthread̶߳
+			createThread();
+		}
+	}
+
+	// һηһֻȡһ֪ͨһΣ
+	void dispatchBatch(std::vector<Task>& batch, const char* label = "fd event")
+	{
+		long long submitTime = isTraceEnabled_ || isFairQueue_ ? steadyNow() : 0;
+		std::unique_lock<std::mutex> lock(taskQueMtx_);
+		Tenant* tenant = tenants_[0].get();
+		for (auto& task : batch) {
+			tenant->taskQue.push(TaskItem{ std::move(task), label, submitTime, tenant });
+			taskSize_++;
+		}
+		notEmpty_.notify_all();
+		growThread();
+	}
+
+	// ȨصĲѯ(DRR)ѡһȡ⻧ǰҪȡtaskQueMtx_taskSize_ > 0
+	// ÿ⻧ÿֵõweight * TENANT_QUANTUMĶȣִ۳ʵִʱ䣬
+	// Ծʱ⻧Ȩط̵ִֵ߳ʱ䣬⻧ʱһ⻧Ҳ߳
+	Tenant* pickTenant()
+	{
+		size_t size = tenants_.size();
+		if (size == 1)
+			return tenants_[0].get();
+
+		for (;;) {
+			for (size_t i = 0; i < size; i++) {
+				size_t index = (drrIndex_ + i) % size;
+				Tenant* tenant = tenants_[index].get();
+				if (tenant->taskQue.size() > 0 && tenant->deficit > 0) {
+					drrIndex_ = index;
+					return tenant;
+				}
+			}
+
+			// ⻧ȶˣҪһβȣû⻧۶
+			long long rounds = -1;
+			for (auto& tenant : tenants_) {
+				if (tenant->taskQue.size() > 0) {
+					long long need = -tenant->deficit / ((long long)tenant->weight * TENANT_QUANTUM) + 1;
+					if (rounds < 0 || need < rounds)
+						rounds = need;
+				}
+			}
+			for (auto& tenant : tenants_) {
+				if (tenant->taskQue.size() > 0)
+					tenant->deficit += rounds * tenant->weight * TENANT_QUANTUM;
+				else if (tenant->deficit > 0)
+					tenant->deficit = 0;
+			}
+			drrIndex_ = (drrIndex_ + 1) % size;
+		}
+	}
+
+	// ǰ̳߳߳أ̳߳ص߳ʱΪnullptr
+	static BasicThreadPool*& currentPool()
+	{
+		thread_local BasicThreadPool* pool = nullptr;
+		return pool;
+	}
+
+	// ߳̽䣬̲߳ʱһ̣߳Ƿ˱߳
+	bool beginBlocking()
+	{
+		std::unique_lock<std::mutex> lock(taskQueMtx_);
+		// ڼnextе̣ܵ߳Ż
+		flushNextTask(*WorkerContext::current());
+		blockedThreadSize_++;
+		int activeSize = curThreadSize_ - retireThreadSize_ - blockedThreadSize_;
+		if (isPoolRunning_ && activeSize < (int)initThreadSize_
+			&& spareThreadSize_ < spareThreadSizeThreshHold_) {
+			THREADPOOL_LOG(">>>create spare thread");
+			spareThreadSize_++;
+			createThread();
+			return true;
+		}
+		return false;
+	}
+
+	// ߳뿪䣬Ϊı߳˳(һͬһ̶߳)
+	void endBlocking(bool isSpare)
+	{
+		std::unique_lock<std::mutex> lock(taskQueMtx_);
+		blockedThreadSize_--;
+		if (isSpare) {
+			spareThreadSize_--;
+			retireThreadSize_++;
+			notEmpty_.notify_all();
+		}
+	}
+
+	// һ̣߳ǰҪȡtaskQueMtx_
+	void createThread()
+	{
+		// thread̶߳ʱ򣬰̺߳thread̶߳
+		auto ptr = std::make_unique<Thread>(std::bind(&BasicThreadPool::threadFunc, this, std::placeholders::_1), generateId_++);
+		int threadId = ptr->getId();
+		threads_.emplace(threadId, std::move(ptr));
+		threads_[threadId]->start(); // ߳
+		curThreadSize_++;
+		idleThreadSize_++;
+	}
+
+	// ̷߳СĿ±꣬ǰҪȡtaskQueMtx_
+	void addWorker(WorkerContext& worker)
+	{
+		auto it = std::find(workers_.begin(), workers_.end(), nullptr);
+		worker.index_ = (int)(it - workers_.begin());
+		if (it == workers_.end())
+			workers_.push_back(&worker);
+		else
+			*it = &worker;
+	}
+
+	// ȡ߳nextе񣬵ǰҪȡtaskQueMtx_
+	TaskItem popNextTask(WorkerContext& worker)
+	{
+		TaskItem item{ std::move(worker.nextTask_), worker.nextLabel_, worker.nextSubmitTime_, tenants_[0].get() };
+		worker.nextTask_ = nullptr;
+		nextTaskSize_--;
+		return item;
+	}
+
+	// ߳nextеŻУеѾύɹټ(enqueueTaskֻڶδʱ)
+	// cachedģʽºenqueueTaskһ̣߳ǰҪȡtaskQueMtx_
+	void flushNextTask(WorkerContext& worker)
+	{
+		if (worker.nextTask_ == nullptr)
+			return;
+		tenants_[0]->taskQue.push(popNextTask(worker));
+		taskSize_++;
+		notEmpty_.notify_all();
+		growThread();
+	}
+
+	// ȡԼnextе񣬵ǰҪȡtaskQueMtx_
+	bool takeNextTask(WorkerContext& worker, TaskItem& item)
+	{
+		if (worker.nextTask_ == nullptr) {
+			worker.nextRunSize_ = 0;
+			return false;
+		}
+		// ִ̫next񣬷ŻУöеҲִ
+		if (worker.nextRunSize_ >= NEXT_TASK_MAX_RUN && taskSize_ > 0) {
+			worker.nextRunSize_ = 0;
+			flushNextTask(worker);
+			return false;
+		}
+		item = popNextTask(worker);
+		worker.nextRunSize_++;
+		return true;
+	}
+
+	// ߿ס߳nextе񣺴һμ鵽ڣ߳ûпʼµ˵ǰִ˺ܾ
+	// ûпס̼߳һμ飻̶߳ʱ飬߳ÿδȡʱ
+	// ǰҪȡtaskQueMtx_
+	bool stealStalledTask(TaskItem& item)
+	{
+		for (WorkerContext* other : workers_) {
+			if (other == nullptr || other->nextTask_ == nullptr)
+				continue;
+			if (other->runSize_ == other->stallMark_) {
+				item = popNextTask(*other);
+				return true;
+			}
+			other->stallMark_ = other->runSize_;
+		}
+		return false;
+	}
+
+	// յǰ̵߳ԴǰҪȡtaskQueMtx_
+	void removeThread(int threadid)
+	{
+		workers_[WorkerContext::current()->getIndex()] = nullptr;
+		threads_.erase(threadid);
+		curThreadSize_--;
+		idleThreadSize_--;
+
+		THREADPOOL_LOG("threadid: " << std::this_thread::get_id() << "exit!");
+		exitCond_.notify_all();
+	}
+
 	// ̺߳
 	void threadFunc(int threadid)
 	{
-		auto lastTime = std::chrono::high_resolution_clock().now();
+		// ֻпܻն̵߳ĲԲҪ¼ʱ
+		auto lastTime = SizePolicy::canGrow() ? std::chrono::high_resolution_clock().now()
+			: std::chrono::high_resolution_clock::time_point();
+		currentPool() = this;
+		WorkerContext worker;
+		{
+			std::unique_lock<std::mutex> lock(taskQueMtx_);
+			addWorker(worker);
+		}
+		WorkerContext::current() = &worker;
+		allocTraceBuffer(worker.getIndex());
+		std::shared_ptr<TraceBuffer> trace; // tracetraceGeneration_仯ʱ
+		unsigned traceGeneration = 0;
 
 		// ִ̳֮߳
 		for (;;) {
-			Task task;
+			TaskItem item;
+			bool isSpun = false;
+			long long startTime = 0; // ж⻧ʱż¼
 			{
 				// Ȼȡ
 				std::unique_lock<std::mutex> lock(taskQueMtx_);
 
-				std::cout << "tid: " << std::this_thread::get_id() << " Իȡ..." << std::endl;
+				THREADPOOL_LOG("tid: " << std::this_thread::get_id() << " Իȡ...");
 
 				// cachedģʽ£ʱ䳬60sĳinitThreadSize_Ķ߳Ҫ
 				// ǰʱ - һִ߳еʱ > 60s
 
+				// ִԼnextе
+				bool isNext = takeNextTask(worker, item);
+
 				//  + ˫ж
-				while (taskQue_.size() == 0) {
+				while (!isNext && (taskSize_ == 0 || retireThreadSize_ > 0)) {
 					// ̳߳ؽ
 					if (!isPoolRunning_) {
 						// ̳߳ؽ߳Դ
-						threads_.erase(threadid);
-						curThreadSize_--;
-						idleThreadSize_--;
-
-						std::cout << "threadid: " << std::this_thread::get_id() << "exit!" << std::endl;
-						exitCond_.notify_all();
+						removeThread(threadid);
 						return; // ̺߳ǽǰ߳
 					}
 
-					if (poolMode_ == PoolMode::MODE_CACHED) {
+					// ߳Сǰ߳˳
+					if (retireThreadSize_ > 0) {
+						retireThreadSize_--;
+						removeThread(threadid);
+						return;
+					}
+
+					// ̵߳nextʱһ߳ÿNEXT_TASK_STALL_TIMEһΣ
+					// ۵˿ס(еȴĽ)߲е񣬷һֱòִ
+					if (nextTaskSize_ > 0 && !isStallWatching_) {
+						if (stealStalledTask(item)) {
+							isNext = true;
+							break;
+						}
+						isStallWatching_ = true;
+						auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(NEXT_TASK_STALL_TIME);
+						while (notEmpty_.wait_until(lock, deadline) == std::cv_status::no_timeout
+							&& taskSize_ == 0 && nextTaskSize_ > 0 && isPoolRunning_ && retireThreadSize_ == 0);
+						isStallWatching_ = false;
+						continue;
+					}
+
+					// ȴֻÿοпʼʱһ
+					if (IdlePolicy::spinCount() > 0 && !isSpun) {
+						isSpun = true;
+						lock.unlock();
+						for (int i = 0; i < IdlePolicy::spinCount() && taskSize_ == 0; i++) {
+							std::this_thread::yield();
+						}
+						lock.lock();
+						continue; // ¼˳
+					}
+
+					if (SizePolicy::isCached(poolMode_)) {
 						// ʱ
-						if (std::cv_status::timeout == notEmpty_.wait_for(lock, std::chrono::seconds(1))) {
+						waitThreadSize_++;
+						std::cv_status status = notEmpty_.wait_for(lock, std::chrono::seconds(1));
+						waitThreadSize_--;
+						if (std::cv_status::timeout == status) {
 							auto now = std::chrono::high_resolution_clock().now();
 							auto dur = std::chrono::duration_cast<std::chrono::seconds>(now - lastTime);
-							if (dur.count() >= THREAD_MAX_IDLE_TIME
-								&& curThreadSize_ > initThreadSize_) {
+							// Ѿ˳֪̻ͨ߳˳̣߳߳initThreadSize_
+							// ߳ʱendBlockingգҲ߳
+							if (dur.count() >= threadMaxIdleTime_
+								&& curThreadSize_ - retireThreadSize_ - spareThreadSize_ > (int)initThreadSize_) {
 								// ʼյǰ߳
 								// ¼ֵ߳޸
 								// ̶߳߳бɾ
-								threads_.erase(threadid);
-								curThreadSize_--;
-								idleThreadSize_--;
-
-								std::cout << "threadid: " << std::this_thread::get_id() << "exit!" << std::endl;
+								removeThread(threadid);
 								return; // ̺߳ǽǰ߳
 							}
 						}
 					}
 					else {
 						// ȴnotEmpty
+						waitThreadSize_++;
 						notEmpty_.wait(lock);
+						waitThreadSize_--;
 					}
 
 				}
 
+				// һֱʱûп̼߳nextۣȡʱҲһΣ
+				// еȴnext߳Ҫȵп˲ܼ
+				bool isStolen = !isNext && nextTaskSize_ > 0 && stealStalledTask(item);
+				if (isStolen)
+					isNext = true;
+
+				if (SizePolicy::canGrow())
+					idleThreadSize_--;
+				worker.runSize_++;
+				if (isStolen)
+					growThread(); // ߳ûȥִжеcachedģʽ°貹һ߳
+
+				THREADPOOL_LOG("tid: " << std::this_thread::get_id() << " ȡɹ...");
 
-				idleThreadSize_--;
+				if (!isNext) {
+					// ȡһж⻧ʱȨѡ⻧
+					Tenant* tenant = pickTenant();
+					item = std::move(tenant->taskQue.front());
+					tenant->taskQue.pop();
+					taskSize_--;
 
-				std::cout << "tid: " << std::this_thread::get_id() << " ȡɹ..." << std::endl;
+					// ж⻧ʱͳŶʱ䣬¼ʼִеʱ۳
+					if (isFairQueue_) {
+						startTime = steadyNow();
+						long long waitTime = item.submitTime != 0 ? startTime - item.submitTime : 0;
+						tenant->startedSize++;
+						tenant->waitTime += waitTime;
+						tenant->maxWaitTime = std::max(tenant->maxWaitTime, waitTime);
+					}
 
-				// ȡһ
-				task = taskQue_.front();
-				taskQue_.pop();
-				taskSize_--;
+					// ֪ͨnotFull_
+					notFull_.notify_all();
+				}
 
 				// Ȼʣ񣬼ִ֪ͨ߳
-				if (taskQue_.size() > 0) {
+				if (taskSize_ > 0) {
 					notEmpty_.notify_all();
 				}
-
-				// ֪ͨnotFull_
-				notFull_.notify_all();
 			}// ͷ
 
-			// ǰ̸ִ߳
-			if (task != nullptr) {
-				task(); // ִfunction<void()>
+			// ǰ̸ִ߳ûпtraceʱֻһж
+			if (isTraceEnabled_.load(std::memory_order_relaxed)) {
+				runTraced(item, worker.getIndex(), trace, traceGeneration);
+			}
+			else if (item.task != nullptr) {
+				item.task(); // ִfunction<void()>
+			}
+			worker.getArena().reset(); // ʹõʱڴ
+			if (startTime != 0) {
+				long long runTime = steadyNow() - startTime;
+				item.tenant->deficit -= runTime;
+				item.tenant->runTime += runTime;
+			}
+			if (SizePolicy::canGrow()) {
+				idleThreadSize_++;
+				lastTime = std::chrono::high_resolution_clock().now(); // ִ߳ʱ
 			}
-			idleThreadSize_++;
-			lastTime = std::chrono::high_resolution_clock().now(); // ִ߳ʱ
 		}
 
 		return;
@@ -307,6 +1435,8 @@ private:
 	}
 };
 
+// Ĭϵ̳߳أģʽsetMode
+using ThreadPool = BasicThreadPool<>;
 
 #endif // !THREADPOOL_H
 
@@ -0,0 +1,195 @@
+#ifndef WORKER_H
+#define WORKER_H
+
+#include <vector>
+#include <memory>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <algorithm>
+#include <functional>
+
+const size_t WORKER_ARENA_BLOCK_SIZE = 64 * 1024; // ߳ڴÿССλֽ
+const size_t WORKER_ARENA_MAX_SIZE = 4 * 1024 * 1024; // resetౣڴ棬λֽ
+
+/*
+̶߳ռĵڴأֻƶָ룬ܵͷţresetʱ
+̳߳ÿִresetҲʱresetЭԼڴأЭ̽ʱ
+Ķ󲻻ʺϴʱĻƽ
+*/
+class WorkerArena
+{
+public:
+	WorkerArena()
+		: ptr_(nullptr)
+		, end_(nullptr)
+	{}
+
+	// sizeֽڣalign룬alignҪ2
+	void* allocate(size_t size, size_t align = alignof(std::max_align_t))
+	{
+		uintptr_t p = ((uintptr_t)ptr_ + align - 1) & ~(uintptr_t)(align - 1);
+		if (end_ == nullptr || p + size > (uintptr_t)end_)
+			p = grow(size, align);
+		ptr_ = (char*)(p + size);
+		return (void*)p;
+	}
+
+	// nT飬ù캯
+	template<typename T>
+	T* allocateArray(size_t n)
+	{
+		return (T*)allocate(n * sizeof(T), alignof(T));
+	}
+
+	// зڴ棬ùʱϲһ飬´β
+	void reset()
+	{
+		if (blocks_.size() > 1) {
+			size_t total = 0;
+			for (auto& block : blocks_) {
+				total += block.second;
+			}
+			blocks_.clear();
+			ptr_ = end_ = nullptr;
+			newBlock(std::min(total, WORKER_ARENA_MAX_SIZE));
+		}
+		else if (!blocks_.empty()) {
+			ptr_ = blocks_[0].first.get();
+		}
+	}
+
+	// ǰеڴС
+	size_t capacity() const
+	{
+		size_t total = 0;
+		for (auto& block : blocks_) {
+			total += block.second;
+		}
+		return total;
+	}
+
+	WorkerArena(const WorkerArena&) = delete;
+	WorkerArena& operator=(const WorkerArena&) = delete;
+private:
+	std::vector<std::pair<std::unique_ptr<char[]>, size_t>> blocks_; // ڴĴС
+	char* ptr_; // ǰһηλ
+	char* end_; // ǰĽβ
+
+	void newBlock(size_t size)
+	{
+		blocks_.emplace_back(std::unique_ptr<char[]>(new char[size]), size);
+		ptr_ = blocks_.back().first.get();
+		end_ = ptr_ + size;
+	}
+
+	// ǰŲʱ¿飬¿һ
+	uintptr_t grow(size_t size, size_t align)
+	{
+		size_t blockSize = std::max(WORKER_ARENA_BLOCK_SIZE, size + align);
+		if (!blocks_.empty())
+			blockSize = std::max(blockSize, blocks_.back().second * 2);
+		newBlock(blockSize);
+		return ((uintptr_t)ptr_ + align - 1) & ~(uintptr_t)(align - 1);
+	}
+};
+
+template<typename SizePolicy, typename QueuePolicy, typename IdlePolicy>
+class BasicThreadPool;
+
+/*
+̳߳ÿ̵߳ģͨThreadPool::currentWorker()лȡ
+example:
+WorkerContext* worker = ThreadPool::currentWorker();
+char* buf = worker->getArena().allocateArray<char>(4096); // Զ
+auto& counter = worker->local<std::vector<int>>(); // ÿ߳һݣһηʱ
+shards[worker->getIndex()] += 1; // ±[0, ߳)ڣƬ
+*/
+class WorkerContext
+{
+public:
+	WorkerContext()
+		: index_(-1)
+		, activeArena_(&arena_)
+		, nextLabel_(nullptr)
+		, nextSubmitTime_(0)
+		, nextRunSize_(0)
+		, runSize_(0)
+		, stallMark_(0)
+	{}
+
+	// ̵߳±꣬ͬһʱ̸̵߳±겻ظ߳˳±̸߳
+	int getIndex() const { return index_; }
+
+	// ̵߳ڴأЭִʱΪЭԼڴ
+	WorkerArena& getArena() { return *activeArena_; }
+
+	// ֲ߳̾洢ÿ߳һTһηʱĬϹ죬߳˳ʱ
+	template<typename T>
+	T& local()
+	{
+		std::shared_ptr<void>& slot = getSlot(slotId<T>());
+		if (slot == nullptr)
+			slot = std::make_shared<T>();
+		return *static_cast<T*>(slot.get());
+	}
+
+	// ֲ߳̾洢һηʱinit()ķֵ
+	template<typename T, typename Init>
+	T& local(Init init)
+	{
+		std::shared_ptr<void>& slot = getSlot(slotId<T>());
+		if (slot == nullptr)
+			slot = std::make_shared<T>(init());
+		return *static_cast<T*>(slot.get());
+	}
+
+	// ǰ̵߳ģ̳߳ص߳ʱΪnullptr
+	static WorkerContext*& current()
+	{
+		thread_local WorkerContext* worker = nullptr;
+		return worker;
+	}
+
+	WorkerContext(const WorkerContext&) = delete;
+	WorkerContext& operator=(const WorkerContext&) = delete;
+private:
+	template<typename SizePolicy, typename QueuePolicy, typename IdlePolicy>
+	friend class BasicThreadPool;
+
+	int index_;
+	WorkerArena arena_;
+	WorkerArena* activeArena_; // getArenaصڴأִ̳߳ЭڼָЭ̵ڴ
+	std::vector<std::shared_ptr<void>> slots_; // ͱŴŵֲ߳̾
+
+	// nextִۣ߳ʱύ񣬵ǰִ߳У̳߳taskQueMtx_·
+	std::function<void()> nextTask_;
+	const char* nextLabel_;
+	long long nextSubmitTime_;
+	int nextRunSize_; // ִnextĴ
+	unsigned long long runSize_; // ʼִй
+	unsigned long long stallMark_; // һμǷסʱrunSize_
+
+	std::shared_ptr<void>& getSlot(size_t id)
+	{
+		if (id >= slots_.size())
+			slots_.resize(id + 1);
+		return slots_[id];
+	}
+
+	// ÿһţ̳߳ع
+	template<typename T>
+	static size_t slotId()
+	{
+		static size_t id = nextSlotId()++;
+		return id;
+	}
+
+	static std::atomic<size_t>& nextSlotId()
+	{
+		static std::atomic<size_t> id(0);
+		return id;
+	}
+};
+
+#endif // !WORKER_H